@@ -1,5 +1,5 @@
 SerialJSONObjects = Define.Objects
 { 
 	Sources = Item '*.cxx',
-	BuildFlags = '-fPIC'
+	BuildFlags = '-fPIC -std=c++17'
 }
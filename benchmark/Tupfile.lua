@@ -0,0 +1,10 @@
+DoOnce '../Tupfile.lua'
+
+Define.Executable
+{
+	Name = 'serialbench',
+	Sources = Item 'benchmark.cxx',
+	BuildFlags = '-std=c++17',
+	Objects = SerialJSONObjects,
+	LinkFlags = '-lyajl -lpthread'
+}
@@ -0,0 +1,543 @@
+#include "../serial.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Usage: serialbench [scale] [iterations] [scratch directory]
+// Writes one JSON object per corpus and phase to stdout.  Each phase runs in its own process, so peak_rss_kb is that
+// phase's peak.  Exits non-zero if a round trip doesn't reproduce its input.
+
+static std::atomic<uint64_t> Allocations(0);
+
+void *operator new(size_t Size)
+{
+	++Allocations;
+	if (auto Out = malloc(Size ? Size : 1)) return Out;
+	throw std::bad_alloc();
+}
+void *operator new[](size_t Size) { return operator new(Size); }
+void operator delete(void *Pointer) noexcept { free(Pointer); }
+void operator delete[](void *Pointer) noexcept { free(Pointer); }
+void operator delete(void *Pointer, size_t) noexcept { free(Pointer); }
+void operator delete[](void *Pointer, size_t) noexcept { free(Pointer); }
+
+using namespace Serial;
+
+struct CorpusT
+{
+	std::string Name;
+	std::function<size_t(WriteObjectT &Object)> Write; // Returns value count
+	std::function<void(ReadT &Read, size_t &Values)> Read;
+};
+
+// yajl's generator is limited to 128 levels
+static size_t const Depth = 100;
+
+static void WriteDeep(WriteObjectT &Object, size_t Level)
+{
+	Object.Int("level", Level);
+	if (Level + 1 < Depth)
+	{
+		auto Child = Object.Object("child");
+		WriteDeep(Child, Level + 1);
+	}
+}
+
+static ReadErrorT ReadDeep(ReadObjectT &Object, size_t &Values)
+{
+	Object.Int("level", [&Values](int64_t) -> ReadErrorT { ++Values; return {}; });
+	Object.Object("child", [&Values](ReadObjectT &Child) { return ReadDeep(Child, Values); });
+	return {};
+}
+
+static std::vector<CorpusT> Corpora(size_t Scale, PolymorphRegistryT &Registry, size_t &PolymorphValues)
+{
+	std::vector<CorpusT> Out;
+
+	Out.push_back({
+		"wide",
+		[Scale](WriteObjectT &Object)
+		{
+			for (size_t Index = 0; Index < 1000 * Scale; ++Index)
+				Object.Int((StringT() << "key" << Index).str(), Index);
+			return 1000 * Scale;
+		},
+		[Scale](ReadT &Read, size_t &Values)
+		{
+			Read.Object([Scale, &Values](ReadObjectT &Object) -> ReadErrorT
+			{
+				for (size_t Index = 0; Index < 1000 * Scale; ++Index)
+					Object.Int((StringT() << "key" << Index).str(), [&Values](int64_t) -> ReadErrorT { ++Values; return {}; });
+				return {};
+			});
+		}});
+
+	Out.push_back({
+		"deep",
+		[Scale](WriteObjectT &Object)
+		{
+			auto Array = Object.Array("trees");
+			for (size_t Index = 0; Index < 10 * Scale; ++Index)
+			{
+				auto Tree = Array.Object();
+				WriteDeep(Tree, 0);
+			}
+			return 10 * Scale * Depth;
+		},
+		[](ReadT &Read, size_t &Values)
+		{
+			Read.Object([&Values](ReadObjectT &Object) -> ReadErrorT
+			{
+				Object.Array("trees", [&Values](ReadArrayT &Array) -> ReadErrorT
+				{
+					Array.Object([&Values](ReadObjectT &Tree) { return ReadDeep(Tree, Values); });
+					return {};
+				});
+				return {};
+			});
+		}});
+
+	Out.push_back({
+		"numeric",
+		[Scale](WriteObjectT &Object)
+		{
+			{
+				auto Array = Object.Array("ints");
+				for (size_t Index = 0; Index < 50000 * Scale; ++Index) Array.Int(Index * 7919);
+			}
+			{
+				auto Array = Object.Array("floats");
+				for (size_t Index = 0; Index < 50000 * Scale; ++Index) Array.Float(Index * 0.37f);
+			}
+			return 100000 * Scale;
+		},
+		[](ReadT &Read, size_t &Values)
+		{
+			Read.Object([&Values](ReadObjectT &Object) -> ReadErrorT
+			{
+				Object.Array("ints", [&Values](ReadArrayT &Array) -> ReadErrorT
+				{
+					Array.Int([&Values](int64_t) -> ReadErrorT { ++Values; return {}; });
+					return {};
+				});
+				Object.Array("floats", [&Values](ReadArrayT &Array) -> ReadErrorT
+				{
+					Array.Float([&Values](float) -> ReadErrorT { ++Values; return {}; });
+					return {};
+				});
+				return {};
+			});
+		}});
+
+	Out.push_back({
+		"string",
+		[Scale](WriteObjectT &Object)
+		{
+			auto Array = Object.Array("strings");
+			std::string Text = "The quick brown fox jumps over the lazy dog \"quoted\" \\ escaped ";
+			for (size_t Index = 0; Index < 20000 * Scale; ++Index)
+				Array.String(Text.substr(0, 8 + Index % (Text.size() - 8)));
+			return 20000 * Scale;
+		},
+		[](ReadT &Read, size_t &Values)
+		{
+			Read.Object([&Values](ReadObjectT &Object) -> ReadErrorT
+			{
+				Object.Array("strings", [&Values](ReadArrayT &Array) -> ReadErrorT
+				{
+					Array.String([&Values](std::string &&) -> ReadErrorT { ++Values; return {}; });
+					return {};
+				});
+				return {};
+			});
+		}});
+
+	Out.push_back({
+		"binary",
+		[Scale](WriteObjectT &Object)
+		{
+			auto Array = Object.Array("blobs");
+			std::vector<uint8_t> Bytes(4096);
+			for (size_t Index = 0; Index < Bytes.size(); ++Index) Bytes[Index] = Index * 31;
+			for (size_t Index = 0; Index < 200 * Scale; ++Index) Array.Binary(&Bytes[0], Bytes.size());
+			return 200 * Scale;
+		},
+		[](ReadT &Read, size_t &Values)
+		{
+			Read.Object([&Values](ReadObjectT &Object) -> ReadErrorT
+			{
+				Object.Array("blobs", [&Values](ReadArrayT &Array) -> ReadErrorT
+				{
+					Array.Binary([&Values](std::vector<uint8_t> &&) -> ReadErrorT { ++Values; return {}; });
+					return {};
+				});
+				return {};
+			});
+		}});
+
+	static char const *PolymorphTypes[] = {"PointerMoveEvent", "KeyPressEvent", "ResizeEvent", "ScrollEvent"};
+	for (auto Type : PolymorphTypes)
+		Registry.Add(Type, [&PolymorphValues](ReadObjectT &Object) -> ReadErrorT
+		{
+			Object.Int("x", [&PolymorphValues](int64_t) -> ReadErrorT { ++PolymorphValues; return {}; });
+			Object.Int("y", [&PolymorphValues](int64_t) -> ReadErrorT { ++PolymorphValues; return {}; });
+			return {};
+		});
+	Out.push_back({
+		"polymorph",
+		[Scale, &Registry](WriteObjectT &Object)
+		{
+			auto Array = Object.Array("events");
+			for (size_t Index = 0; Index < 20000 * Scale; ++Index)
+			{
+				WritePolymorphT Event(Registry, Index % 4, Array.Polymorph());
+				Event.Int("x", Index);
+				Event.Int("y", Index * 2);
+			}
+			return 20000 * Scale * 2;
+		},
+		[&Registry, &PolymorphValues](ReadT &Read, size_t &Values)
+		{
+			PolymorphValues = 0;
+			Read.Object([&Registry, &PolymorphValues, &Values](ReadObjectT &Object) -> ReadErrorT
+			{
+				Object.Array("events", [&Registry](ReadArrayT &Array) -> ReadErrorT
+				{
+					Array.Polymorph(Registry);
+					return {};
+				});
+				Object.Finally([&PolymorphValues, &Values](void) -> ReadErrorT { Values += PolymorphValues; return {}; });
+				return {};
+			});
+		}});
+
+	Out.push_back({
+		"large",
+		[Scale](WriteObjectT &Object)
+		{
+			auto Array = Object.Array("records");
+			for (size_t Index = 0; Index < 100000 * Scale; ++Index)
+			{
+				auto Record = Array.Object();
+				Record.UInt("id", Index);
+				Record.String("name", (StringT() << "record-" << Index).str());
+				Record.Float("weight", Index * 1.5f);
+				Record.Bool("active", Index % 3 == 0);
+			}
+			return 100000 * Scale * 4;
+		},
+		[](ReadT &Read, size_t &Values)
+		{
+			Read.Object([&Values](ReadObjectT &Object) -> ReadErrorT
+			{
+				Object.Array("records", [&Values](ReadArrayT &Array) -> ReadErrorT
+				{
+					Array.Object([&Values](ReadObjectT &Record) -> ReadErrorT
+					{
+						Record.UInt("id", [&Values](uint64_t) -> ReadErrorT { ++Values; return {}; });
+						Record.String("name", [&Values](std::string &&) -> ReadErrorT { ++Values; return {}; });
+						Record.Float("weight", [&Values](float) -> ReadErrorT { ++Values; return {}; });
+						Record.Bool("active", [&Values](bool) -> ReadErrorT { ++Values; return {}; });
+						return {};
+					});
+					return {};
+				});
+				return {};
+			});
+		}});
+
+	return Out;
+}
+
+// Writes a parsed document back out, so a round trip can be compared with its input
+static void RewriteMembers(DomT const &Dom, DomT::NodeIDT Node, WriteObjectT &Object);
+
+template <typename ParentT, typename ...KeyT> static void RewriteNode(DomT const &Dom, DomT::NodeIDT Node, ParentT &Parent, KeyT const &...Key)
+{
+	switch (Dom.Type(Node))
+	{
+		case DomT::TypeT::Bool: Parent.Bool(Key..., Dom.Bool(Node)); break;
+		case DomT::TypeT::Number:
+		{
+			// Int and UInt only accept whole integer text, so yajl's doubles (always with a fraction) stay floats
+			if (auto Value = Dom.Int(Node)) Parent.Int(Key..., *Value);
+			else if (auto Value = Dom.UInt(Node)) Parent.UInt(Key..., *Value);
+			else if (auto Value = Dom.Float(Node)) Parent.Float(Key..., *Value);
+			break;
+		}
+		case DomT::TypeT::String: Parent.String(Key..., std::string(Dom.String(Node))); break;
+		case DomT::TypeT::Binary: 
+		{
+			auto Bytes = Dom.Binary(Node);
+			Parent.Binary(Key..., Bytes.data(), Bytes.size()); 
+			break;
+		}
+		case DomT::TypeT::Object:
+		{
+			auto Child = Parent.Object(Key...);
+			RewriteMembers(Dom, Node, Child);
+			break;
+		}
+		case DomT::TypeT::Array:
+		{
+			auto Child = Parent.Array(Key...);
+			for (size_t Index = 0; Index < Dom.Count(Node); ++Index) RewriteNode(Dom, Dom.Child(Node, Index), Child);
+			break;
+		}
+	}
+}
+
+static void RewriteMembers(DomT const &Dom, DomT::NodeIDT Node, WriteObjectT &Object)
+{
+	for (size_t Index = 0; Index < Dom.Count(Node); ++Index)
+	{
+		auto Child = Dom.Child(Node, Index);
+		RewriteNode(Dom, Child, Object, std::string(Dom.Key(Child)));
+	}
+}
+
+static bool Verify(std::string const &Corpus, std::string const &Text)
+{
+	DomT Dom;
+	if (auto Error = Dom.Parse(std::istringstream(Text)))
+	{
+		std::cerr << "Error reading corpus " << Corpus << " for verification: " << *Error << std::endl;
+		return false;
+	}
+	WriteT Writer;
+	{
+		auto Object = Writer.Object();
+		RewriteMembers(Dom, Dom.Root(), Object);
+	}
+	if (Writer.Dump() == Text) return true;
+	std::cerr << "Round trip of corpus " << Corpus << " doesn't reproduce its input." << std::endl;
+	return false;
+}
+
+// Runs Phase in a child process; returns false if it failed
+static bool Isolate(std::function<bool(void)> const &Phase)
+{
+	std::cout.flush();
+	auto Child = fork();
+	if (Child < 0) 
+	{
+		perror("fork");
+		return false;
+	}
+	if (Child == 0)
+	{
+		bool const Succeeded = Phase();
+		std::cout.flush();
+		_exit(Succeeded ? 0 : 1);
+	}
+	int Status;
+	return (waitpid(Child, &Status, 0) == Child) && WIFEXITED(Status) && (WEXITSTATUS(Status) == 0);
+}
+
+struct MeasureT
+{
+	double Seconds = 0;
+	uint64_t Bytes = 0;
+	uint64_t Values = 0;
+	uint64_t Allocations = 0;
+};
+
+static long PeakRSS(void)
+{
+	struct rusage Usage;
+	getrusage(RUSAGE_SELF, &Usage);
+	return Usage.ru_maxrss;
+}
+
+static void Report(std::string const &Corpus, char const *Phase, MeasureT const &Measure, size_t Iterations)
+{
+	auto Seconds = Measure.Seconds / Iterations;
+	auto Bytes = Measure.Bytes / Iterations;
+	auto Values = Measure.Values / Iterations;
+	std::cout <<
+		"{\"corpus\": \"" << Corpus << "\", " <<
+		"\"phase\": \"" << Phase << "\", " <<
+		"\"iterations\": " << Iterations << ", " <<
+		"\"seconds\": " << Seconds << ", " <<
+		"\"bytes\": " << Bytes << ", " <<
+		"\"values\": " << Values << ", " <<
+		"\"mb_per_second\": " << (Bytes / (1024.0 * 1024.0) / Seconds) << ", " <<
+		"\"values_per_second\": " << (Values / Seconds) << ", " <<
+		"\"allocations_per_value\": " << (static_cast<double>(Measure.Allocations) / Measure.Values) << ", " <<
+		"\"peak_rss_kb\": " << PeakRSS() << "}" << std::endl;
+}
+
+int main(int ArgumentCount, char **Arguments)
+{
+	size_t Scale = ArgumentCount > 1 ? strtoul(Arguments[1], nullptr, 10) : 1;
+	size_t Iterations = ArgumentCount > 2 ? strtoul(Arguments[2], nullptr, 10) : 5;
+	std::string Scratch = ArgumentCount > 3 ? Arguments[3] : ".";
+	if (Scale == 0) Scale = 1;
+	if (Iterations == 0) Iterations = 1;
+
+	typedef std::chrono::steady_clock ClockT;
+	auto Elapsed = [](ClockT::time_point Start)
+		{ return std::chrono::duration<double>(ClockT::now() - Start).count(); };
+
+	bool Succeeded = true;
+	PolymorphRegistryT Registry;
+	size_t PolymorphValues = 0;
+	for (auto &Corpus : Corpora(Scale, Registry, PolymorphValues))
+	{
+		MeasureT Write, ReadMeasure, RoundTrip;
+		auto const Path = Scratch + "/serialbench_" + Corpus.Name + ".json";
+
+		auto WriteOnce = [&](MeasureT &Measure) -> std::string
+		{
+			auto StartAllocations = Allocations.load();
+			auto Start = ClockT::now();
+			WriteT Writer;
+			size_t Values;
+			{
+				auto Object = Writer.Object();
+				Values = Corpus.Write(Object);
+			}
+			auto Out = Writer.Dump();
+			Measure.Seconds += Elapsed(Start);
+			Measure.Allocations += Allocations.load() - StartAllocations;
+			Measure.Bytes += Out.size();
+			Measure.Values += Values;
+			return Out;
+		};
+
+		auto ReadOnce = [&](MeasureT &Measure, std::string const &Text) -> bool
+		{
+			auto StartAllocations = Allocations.load();
+			auto Start = ClockT::now();
+			size_t Values = 0;
+			ReadT Reader;
+			Corpus.Read(Reader, Values);
+			auto Error = Corpus.Name == "large" ?
+				Reader.Parse(std::ifstream(Path, std::ios::binary)) :
+				Reader.Parse(std::istringstream(Text));
+			Measure.Seconds += Elapsed(Start);
+			Measure.Allocations += Allocations.load() - StartAllocations;
+			Measure.Bytes += Text.size();
+			Measure.Values += Values;
+			if (!Error) return true;
+			std::cerr << "Error reading corpus " << Corpus.Name << ": " << *Error << std::endl;
+			return false;
+		};
+
+		auto Store = [&](std::string const &Text) -> bool
+		{
+			if (Corpus.Name != "large") return true;
+			std::ofstream File(Path, std::ios::binary);
+			File.write(Text.c_str(), Text.size());
+			File.close();
+			if (File) return true;
+			std::cerr << "Unable to write corpus " << Corpus.Name << " to " << Path << "." << std::endl;
+			return false;
+		};
+
+		Succeeded = Isolate([&](void)
+		{
+			for (size_t Iteration = 0; Iteration < Iterations; ++Iteration) WriteOnce(Write);
+			Report(Corpus.Name, "write", Write, Iterations);
+			return true;
+		}) && Succeeded;
+
+		Succeeded = Isolate([&](void)
+		{
+			MeasureT WriteIgnored;
+			auto Text = WriteOnce(WriteIgnored);
+			if (!Store(Text)) return false;
+			bool Read = true;
+			for (size_t Iteration = 0; Iteration < Iterations; ++Iteration) Read = ReadOnce(ReadMeasure, Text) && Read;
+			Report(Corpus.Name, "read", ReadMeasure, Iterations);
+			return Read;
+		}) && Succeeded;
+
+		Succeeded = Isolate([&](void)
+		{
+			bool Verified = true;
+			for (size_t Iteration = 0; Iteration < Iterations; ++Iteration)
+			{
+				MeasureT WriteIgnored, ReadIgnored;
+				auto Start = ClockT::now();
+				auto StartAllocations = Allocations.load();
+				auto Text = WriteOnce(WriteIgnored);
+				if (!Store(Text)) return false;
+				bool const Read = ReadOnce(ReadIgnored, Text);
+				RoundTrip.Seconds += Elapsed(Start);
+				RoundTrip.Allocations += Allocations.load() - StartAllocations;
+				RoundTrip.Bytes += Text.size();
+				RoundTrip.Values += ReadIgnored.Values;
+				Verified = Read && Verify(Corpus.Name, Text) && Verified; // Not timed
+			}
+			Report(Corpus.Name, "roundtrip", RoundTrip, Iterations);
+			return Verified;
+		}) && Succeeded;
+
+		if (Corpus.Name == "large") remove(Path.c_str());
+	}
+
+	// Many small documents, as when serializing request responses: a new writer each time versus a pooled writer 
+	// whose buffer is swapped out
+	{
+		size_t const Responses = 10000 * Scale;
+		auto WriteResponse = [](WriteT &Writer, size_t Index)
+		{
+			auto Object = Writer.Object();
+			Object.UInt("id", Index);
+			Object.String("status", "ok");
+			auto Items = Object.Array("items");
+			for (size_t Item = 0; Item < 8; ++Item) Items.Int(Index * Item);
+			return size_t(10);
+		};
+		MeasureT Fresh, Pooled;
+		Succeeded = Isolate([&](void)
+		{
+			for (size_t Iteration = 0; Iteration < Iterations; ++Iteration)
+			{
+				auto StartAllocations = Allocations.load();
+				auto Start = ClockT::now();
+				for (size_t Index = 0; Index < Responses; ++Index)
+				{
+					WriteT Writer;
+					Fresh.Values += WriteResponse(Writer, Index);
+					Fresh.Bytes += Writer.Dump().size();
+				}
+				Fresh.Seconds += Elapsed(Start);
+				Fresh.Allocations += Allocations.load() - StartAllocations;
+			}
+			Report("response", "write_fresh", Fresh, Iterations);
+			return true;
+		}) && Succeeded;
+		Succeeded = Isolate([&](void)
+		{
+			std::pmr::string Out;
+			for (size_t Iteration = 0; Iteration < Iterations; ++Iteration)
+			{
+				auto StartAllocations = Allocations.load();
+				auto Start = ClockT::now();
+				for (size_t Index = 0; Index < Responses; ++Index)
+				{
+					auto Writer = WritePoolT::Local().Acquire();
+					Pooled.Values += WriteResponse(*Writer, Index);
+					Writer->Dump(Out);
+					Pooled.Bytes += Out.size();
+				}
+				Pooled.Seconds += Elapsed(Start);
+				Pooled.Allocations += Allocations.load() - StartAllocations;
+			}
+			Report("response", "write_pooled", Pooled, Iterations);
+			return true;
+		}) && Succeeded;
+	}
+
+	return Succeeded ? 0 : 1;
+}
@@ -1,25 +1,48 @@
 #include "serial.h"
 
 #include <cstring>
+#include <charconv>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef SERIAL_GZIP
+#include <zlib.h>
+#endif
+#ifdef SERIAL_ZSTD
+#include <zstd.h>
+#endif
 
 #include "../ren-cxx-basics/extrastandard.h"
 #include "math.h"
 
+#ifdef SERIAL_STATS
+#define SERIAL_STAT(...) __VA_ARGS__
+#define SERIAL_STAT_ELSE(Counting, Otherwise) Counting
+#else
+#define SERIAL_STAT(...)
+#define SERIAL_STAT_ELSE(Counting, Otherwise) Otherwise
+#endif
+
 static char const StringPrefix[] = "utf8:";
 static char const BinaryPrefix[] = "alpha16:";
 
-static std::vector<char> ToString(std::string const &In)
+static std::pmr::vector<char> ToString(std::string const &In, std::pmr::memory_resource *Resource)
 {
-	std::vector<char> Out;
+	std::pmr::vector<char> Out(Resource);
 	Out.resize(sizeof(StringPrefix) - 1 + In.length());
 	memcpy(&Out[0], StringPrefix, sizeof(StringPrefix) - 1);
 	memcpy(&Out[sizeof(StringPrefix) - 1], In.c_str(), In.length());
 	return Out;
 }
 
-static std::vector<char> ToBinary(uint8_t const *Bytes, size_t const Length)
+static std::pmr::vector<char> ToBinary(uint8_t const *Bytes, size_t const Length, std::pmr::memory_resource *Resource)
 {
-	std::vector<char> Out;
+	std::pmr::vector<char> Out(Resource);
 	Out.resize(sizeof(BinaryPrefix) - 1 + Length * 2);
 	memcpy(&Out[0], BinaryPrefix, sizeof(BinaryPrefix) - 1);
 	for (size_t Index = 0; Index < Length; ++Index)
@@ -30,7 +53,7 @@ static std::vector<char> ToBinary(uint8_t const *Bytes, size_t const Length)
 	return Out;
 }
 
-static std::vector<uint8_t> FromBinary(std::string const &In)
+static std::vector<uint8_t> FromBinary(std::string_view In)
 {
 	if (In.size() % 2 != 0) return {};
 	std::vector<uint8_t> Out(In.size() / 2);
@@ -50,18 +73,602 @@ static std::vector<uint8_t> FromBinary(std::string const &In)
 namespace Serial
 {
 
+#ifdef SERIAL_STATS
+struct StatTimerT
+{
+	StatTimerT(std::chrono::nanoseconds &Total) : Total(Total), Start(std::chrono::steady_clock::now()) {}
+	~StatTimerT(void) { Total += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Start); }
+	std::chrono::nanoseconds &Total;
+	std::chrono::steady_clock::time_point Start;
+};
+#endif
+
+//================================================================================================================
+// Allocation
+CountingResourceT::CountingResourceT(std::pmr::memory_resource *Upstream, uint64_t &Allocations) : Upstream(Upstream), Allocations(Allocations) {}
+
+void *CountingResourceT::do_allocate(size_t Bytes, size_t Alignment)
+{
+	++Allocations;
+	return Upstream->allocate(Bytes, Alignment);
+}
+
+void CountingResourceT::do_deallocate(void *Pointer, size_t Bytes, size_t Alignment) { Upstream->deallocate(Pointer, Bytes, Alignment); }
+
+// Allocation and deallocation go straight to Upstream, so memory is interchangeable with anything Upstream equals
+bool CountingResourceT::do_is_equal(std::pmr::memory_resource const &Other) const noexcept
+{
+	if (this == &Other) return true;
+	auto const Counting = dynamic_cast<CountingResourceT const *>(&Other);
+	return Upstream->is_equal(Counting ? *Counting->Upstream : Other);
+}
+
+//----------------------------------------------------------------------------------------------------------------
+// yajl
+
+// yajl's free and realloc don't pass sizes, so each block is prefixed with its size
+static size_t const AllocHeaderSize = alignof(std::max_align_t);
+
+YAJLAllocatorT::YAJLAllocatorT(std::pmr::memory_resource *Resource) : Resource(Resource) {}
+
+yajl_alloc_funcs YAJLAllocatorT::Funcs(void)
+{
+	static auto Malloc = [](void *Context, size_t Size) -> void *
+	{
+		auto This = reinterpret_cast<YAJLAllocatorT *>(Context);
+		auto Block = reinterpret_cast<uint8_t *>(This->Resource->allocate(AllocHeaderSize + Size, alignof(std::max_align_t)));
+		*reinterpret_cast<size_t *>(Block) = Size;
+		return Block + AllocHeaderSize;
+	};
+	static auto Free = [](void *Context, void *Pointer)
+	{
+		if (!Pointer) return;
+		auto This = reinterpret_cast<YAJLAllocatorT *>(Context);
+		auto Block = reinterpret_cast<uint8_t *>(Pointer) - AllocHeaderSize;
+		This->Resource->deallocate(Block, AllocHeaderSize + *reinterpret_cast<size_t *>(Block), alignof(std::max_align_t));
+	};
+	return 
+	{
+		Malloc,
+		[](void *Context, void *Pointer, size_t Size) -> void *
+		{
+			auto Out = Malloc(Context, Size);
+			if (Pointer)
+			{
+				auto OldSize = *reinterpret_cast<size_t *>(reinterpret_cast<uint8_t *>(Pointer) - AllocHeaderSize);
+				memcpy(Out, Pointer, std::min(OldSize, Size));
+				Free(Context, Pointer);
+			}
+			return Out;
+		},
+		Free,
+		this
+	};
+}
+
+//================================================================================================================
+// Background I/O
+
+static size_t const ChunkSize = 65536;
+static size_t const ChunkCount = 3;
+
+// Fixed set of buffers handed between two threads: one side fills free chunks, the other drains filled chunks.
+// A filled chunk with length 0 marks the end.
+struct ChunkQueueT
+{
+	struct ChunkT
+	{
+		ChunkT(std::pmr::memory_resource *Resource) : Data(ChunkSize, Resource), Length(0) {}
+		std::pmr::vector<uint8_t> Data;
+		size_t Length;
+	};
+	
+	ChunkQueueT(std::pmr::memory_resource *Resource) : FreeChunks(Resource), FilledChunks(Resource), Stopped(false), Chunks(Resource)
+	{
+		Chunks.reserve(ChunkCount);
+		for (size_t Index = 0; Index < ChunkCount; ++Index) 
+		{
+			Chunks.emplace_back(Resource);
+			FreeChunks.push_back(&Chunks.back());
+		}
+	}
+	
+	ChunkT *Free(void) { return Take(FreeChunks); }
+	ChunkT *Filled(void) { return Take(FilledChunks); }
+	void Fill(ChunkT *Chunk) { Give(FilledChunks, Chunk); }
+	void Release(ChunkT *Chunk) { Chunk->Length = 0; Give(FreeChunks, Chunk); }
+	
+	void Stop(void)
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+		Stopped = true;
+		Changed.notify_all();
+	}
+	
+	private:
+		ChunkT *Take(std::pmr::deque<ChunkT *> &From)
+		{
+			std::unique_lock<std::mutex> Lock(Mutex);
+			Changed.wait(Lock, [&](void) { return Stopped || !From.empty(); });
+			if (Stopped) return nullptr;
+			auto Out = From.front();
+			From.pop_front();
+			return Out;
+		}
+		
+		void Give(std::pmr::deque<ChunkT *> &To, ChunkT *Chunk)
+		{
+			std::lock_guard<std::mutex> Lock(Mutex);
+			To.push_back(Chunk);
+			Changed.notify_all();
+		}
+		
+		std::mutex Mutex;
+		std::condition_variable Changed;
+		std::pmr::deque<ChunkT *> FreeChunks, FilledChunks;
+		bool Stopped;
+		std::pmr::vector<ChunkT> Chunks;
+};
+
+// Fills chunks from a source on a background thread while the caller consumes them
+struct ReadAheadT
+{
+	typedef std::function<ReadErrorT(uint8_t *Buffer, size_t Capacity, size_t &Length)> SourceT;
+	
+	ReadAheadT(SourceT const &Source, std::pmr::memory_resource *Resource) : Queue(Resource), Thread([this, Source](void)
+	{
+		while (true)
+		{
+			auto Chunk = Queue.Free();
+			if (!Chunk) break;
+			// One byte is left for a terminator
+			auto Error = Source(&Chunk->Data[0], Chunk->Data.size() - 1, Chunk->Length);
+			if (Error) 
+			{
+				this->Error = Error;
+				Chunk->Length = 0;
+			}
+			auto const Length = Chunk->Length; // The chunk belongs to the reader once filled
+			Queue.Fill(Chunk);
+			if (Length == 0) break;
+		}
+	}) {}
+	
+	~ReadAheadT(void)
+	{
+		Queue.Stop();
+		Thread.join();
+	}
+	
+	ChunkQueueT Queue;
+	ReadErrorT Error; // Valid after the end chunk is received
+	std::thread Thread;
+};
+
+// Drains chunks to a sink on a background thread while the caller fills them
+struct WriteBehindT
+{
+	typedef std::function<bool(uint8_t const *Bytes, size_t Length)> SinkT; // Called with no bytes at the end
+	
+	WriteBehindT(SinkT const &Sink, std::pmr::memory_resource *Resource) : Queue(Resource), Current(Queue.Free()), Failed(false), Thread([this, Sink](void)
+	{
+		while (true)
+		{
+			auto Chunk = Queue.Filled();
+			if (!Chunk) break;
+			auto const Length = Chunk->Length;
+			if (!Failed && !Sink(Length ? &Chunk->Data[0] : nullptr, Length)) Failed = true;
+			Queue.Release(Chunk);
+			if (Length == 0) break;
+		}
+	}) {}
+	
+	~WriteBehindT(void) { Finish(); }
+	
+	void Write(uint8_t const *Bytes, size_t Length)
+	{
+		Assert(Current);
+		while (Length)
+		{
+			auto Part = std::min(Length, Current->Data.size() - Current->Length);
+			memcpy(&Current->Data[Current->Length], Bytes, Part);
+			Current->Length += Part;
+			Bytes += Part;
+			Length -= Part;
+			if (Current->Length == Current->Data.size()) 
+			{
+				Queue.Fill(Current);
+				Current = Queue.Free();
+			}
+		}
+	}
+	
+	// Returns false if any write failed
+	bool Finish(void)
+	{
+		if (!Current) return !Failed;
+		if (Current->Length)
+		{
+			Queue.Fill(Current);
+			Current = Queue.Free();
+		}
+		Queue.Fill(Current); // Empty, marks the end
+		Current = nullptr;
+		Thread.join();
+		return !Failed;
+	}
+	
+	ChunkQueueT Queue;
+	ChunkQueueT::ChunkT *Current;
+	bool Failed; // Only read after the thread is joined
+	std::thread Thread;
+};
+
+//================================================================================================================
+// Compression
+
+bool CompressionSupported(CompressionT Compression)
+{
+	switch (Compression)
+	{
+		case CompressionT::None: return true;
+#ifdef SERIAL_GZIP
+		case CompressionT::GZip: return true;
+#endif
+#ifdef SERIAL_ZSTD
+		case CompressionT::ZStd: return true;
+#endif
+		default: return false;
+	}
+}
+
+// Detects compressed input by its magic bytes and decompresses it; runs on the read-ahead thread
+struct DecodeT
+{
+	DecodeT(ReadAheadT::SourceT const &Raw, std::pmr::memory_resource *Resource) : Raw(Raw), In(Resource) {}
+	
+	~DecodeT(void)
+	{
+#ifdef SERIAL_GZIP
+		if (Format == CompressionT::GZip) inflateEnd(&ZLib);
+#endif
+#ifdef SERIAL_ZSTD
+		if (Format == CompressionT::ZStd) ZSTD_freeDCtx(ZStd);
+#endif
+	}
+	
+	ReadErrorT Read(uint8_t *Buffer, size_t Capacity, size_t &Length)
+	{
+		Length = 0;
+		if (!Detected)
+		{
+			// Uncompressed input is read straight into Buffer; only compressed input needs its own buffer
+			Detected = true;
+			if (auto Error = Raw(Buffer, Capacity, Length)) return Error;
+			if (auto Error = Detect(Buffer, Length)) return Error;
+			if (Format == CompressionT::None) return {};
+			In.resize(std::max(ChunkSize, Capacity));
+			memcpy(&In[0], Buffer, Length);
+			InStart = 0;
+			InEnd = Length;
+			Length = 0;
+		}
+		switch (Format)
+		{
+			case CompressionT::None: return Raw(Buffer, Capacity, Length);
+#ifdef SERIAL_GZIP
+			case CompressionT::GZip:
+			{
+				while (Length == 0)
+				{
+					if ((InStart == InEnd) && !RawEnd) if (auto Error = Refill()) return Error;
+					if (FrameEnded)
+					{
+						if (InStart == InEnd) return {};
+						inflateReset(&ZLib); // Concatenated members
+						FrameEnded = false;
+					}
+					if (InStart == InEnd) return std::string("Compressed data is truncated.");
+					ZLib.next_in = &In[InStart];
+					ZLib.avail_in = InEnd - InStart;
+					ZLib.next_out = Buffer;
+					ZLib.avail_out = Capacity;
+					auto Result = inflate(&ZLib, Z_NO_FLUSH);
+					InStart = InEnd - ZLib.avail_in;
+					Length = Capacity - ZLib.avail_out;
+					if (Result == Z_STREAM_END) FrameEnded = true;
+					else if ((Result != Z_OK) && (Result != Z_BUF_ERROR)) 
+						return (StringT() << "Error decompressing gzip data: " << (ZLib.msg ? ZLib.msg : "unknown error")).str();
+				}
+				return {};
+			}
+#endif
+#ifdef SERIAL_ZSTD
+			case CompressionT::ZStd:
+			{
+				while (Length == 0)
+				{
+					if ((InStart == InEnd) && !RawEnd) if (auto Error = Refill()) return Error;
+					if (InStart == InEnd)
+					{
+						if (!FrameEnded) return std::string("Compressed data is truncated.");
+						return {};
+					}
+					ZSTD_inBuffer Input{&In[0], InEnd, InStart};
+					ZSTD_outBuffer Output{Buffer, Capacity, 0};
+					auto Result = ZSTD_decompressStream(ZStd, &Output, &Input);
+					if (ZSTD_isError(Result)) 
+						return (StringT() << "Error decompressing zstd data: " << ZSTD_getErrorName(Result)).str();
+					InStart = Input.pos;
+					Length = Output.pos;
+					FrameEnded = Result == 0;
+				}
+				return {};
+			}
+#endif
+			default: Assert(false); return std::string("Unsupported compression.");
+		}
+	}
+	
+	private:
+		ReadErrorT Refill(void)
+		{
+			InStart = 0;
+			if (auto Error = Raw(&In[0], In.size(), InEnd)) return Error;
+			if (InEnd == 0) RawEnd = true;
+			return {};
+		}
+		
+		ReadErrorT Detect(uint8_t const *Start, size_t Length)
+		{
+			static uint8_t const GZipMagic[] = {0x1f, 0x8b};
+			static uint8_t const ZStdMagic[] = {0x28, 0xb5, 0x2f, 0xfd};
+			if ((Length >= sizeof(GZipMagic)) && (memcmp(Start, GZipMagic, sizeof(GZipMagic)) == 0))
+			{
+#ifdef SERIAL_GZIP
+				Format = CompressionT::GZip;
+				ZLib = {};
+				if (inflateInit2(&ZLib, 15 + 32) != Z_OK) 
+				{ 
+					Format = CompressionT::None; 
+					return std::string("Unable to initialize gzip decompression."); 
+				}
+				return {};
+#else
+				return std::string("Document is gzip compressed, but gzip support was not built in.");
+#endif
+			}
+			if ((Length >= sizeof(ZStdMagic)) && (memcmp(Start, ZStdMagic, sizeof(ZStdMagic)) == 0))
+			{
+#ifdef SERIAL_ZSTD
+				Format = CompressionT::ZStd;
+				ZStd = ZSTD_createDCtx();
+				if (!ZStd)
+				{
+					Format = CompressionT::None;
+					return std::string("Unable to initialize zstd decompression.");
+				}
+				return {};
+#else
+				return std::string("Document is zstd compressed, but zstd support was not built in.");
+#endif
+			}
+			return {};
+		}
+		
+		ReadAheadT::SourceT Raw;
+		std::pmr::vector<uint8_t> In;
+		size_t InStart = 0, InEnd = 0;
+		bool RawEnd = false;
+		bool Detected = false;
+		bool FrameEnded = false;
+		CompressionT Format = CompressionT::None;
+#ifdef SERIAL_GZIP
+		z_stream ZLib;
+#endif
+#ifdef SERIAL_ZSTD
+		ZSTD_DCtx *ZStd = nullptr;
+#endif
+};
+
+// Compresses output; runs on the write-behind thread.  No bytes finishes the stream.
+struct EncodeT
+{
+	EncodeT(WriteBehindT::SinkT const &Raw, CompressionT Format, std::pmr::memory_resource *Resource) : 
+		Raw(Raw), Format(Format), Out(ChunkSize, Resource)
+	{
+		Assert(CompressionSupported(Format));
+#ifdef SERIAL_GZIP
+		if (Format == CompressionT::GZip) 
+		{
+			ZLib = {};
+			Failed = deflateInit2(&ZLib, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK;
+		}
+#endif
+#ifdef SERIAL_ZSTD
+		if (Format == CompressionT::ZStd) 
+		{
+			ZStd = ZSTD_createCCtx();
+			Failed = !ZStd;
+		}
+#endif
+	}
+	
+	~EncodeT(void)
+	{
+#ifdef SERIAL_GZIP
+		if (Format == CompressionT::GZip) deflateEnd(&ZLib);
+#endif
+#ifdef SERIAL_ZSTD
+		if (Format == CompressionT::ZStd) ZSTD_freeCCtx(ZStd);
+#endif
+	}
+	
+	// False if the encoder couldn't be initialized or the sink failed
+	bool Write(uint8_t const *Bytes, size_t Length)
+	{
+		if (Failed) return false;
+		[[maybe_unused]] bool const Finish = Length == 0; // Unused without compression support
+		switch (Format)
+		{
+#ifdef SERIAL_GZIP
+			case CompressionT::GZip:
+			{
+				ZLib.next_in = const_cast<uint8_t *>(Bytes);
+				ZLib.avail_in = Length;
+				while (true)
+				{
+					ZLib.next_out = &Out[0];
+					ZLib.avail_out = Out.size();
+					auto Result = deflate(&ZLib, Finish ? Z_FINISH : Z_NO_FLUSH);
+					if (Result == Z_STREAM_ERROR) return false;
+					auto Produced = Out.size() - ZLib.avail_out;
+					if (Produced && !Raw(&Out[0], Produced)) return false;
+					if (Finish ? (Result == Z_STREAM_END) : ((ZLib.avail_in == 0) && (ZLib.avail_out != 0))) break;
+				}
+				return Finish ? Raw(nullptr, 0) : true;
+			}
+#endif
+#ifdef SERIAL_ZSTD
+			case CompressionT::ZStd:
+			{
+				ZSTD_inBuffer Input{Bytes, Length, 0};
+				while (true)
+				{
+					ZSTD_outBuffer Output{&Out[0], Out.size(), 0};
+					auto Result = ZSTD_compressStream2(ZStd, &Output, &Input, Finish ? ZSTD_e_end : ZSTD_e_continue);
+					if (ZSTD_isError(Result)) return false;
+					if (Output.pos && !Raw(&Out[0], Output.pos)) return false;
+					if (Finish ? (Result == 0) : (Input.pos == Input.size)) break;
+				}
+				return Finish ? Raw(nullptr, 0) : true;
+			}
+#endif
+			default: return Raw(Bytes, Length);
+		}
+	}
+	
+	private:
+		WriteBehindT::SinkT Raw;
+		CompressionT Format;
+		bool Failed = false;
+		std::pmr::vector<uint8_t> Out;
+#ifdef SERIAL_GZIP
+		z_stream ZLib;
+#endif
+#ifdef SERIAL_ZSTD
+		ZSTD_CCtx *ZStd = nullptr;
+#endif
+};
+
+static WriteBehindT::SinkT FileSink(FILE *File)
+{
+	return [File](uint8_t const *Bytes, size_t Length) 
+		{ return (Length == 0) || (fwrite(Bytes, 1, Length, File) == Length); };
+}
+
 //================================================================================================================
 // Writing
 
-WriteCoreT::WriteCoreT(yajl_gen Base) : Base(Base) {}
+// Output files are written to a temporary sibling, then synced and renamed over the destination.  Each temporary gets
+// a new name, so writers of the same destination don't collide.
+struct TempFileT
+{
+	bool Open(std::string const &Path)
+	{
+		static std::atomic<uint64_t> Count(0);
+		this->Path = Path;
+		while (true)
+		{
+			Temp = (::StringT() << Path << ".tmp." << getpid() << "." << Count++).str();
+			auto Descriptor = open(Temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+			if (Descriptor < 0)
+			{
+				if (errno == EEXIST) continue;
+				return false;
+			}
+			File = fdopen(Descriptor, "wb");
+			if (File) return true;
+			close(Descriptor);
+			remove(Temp.c_str());
+			return false;
+		}
+	}
+	
+	// The destination is untouched unless every write, the sync and the close succeeded
+	bool Replace(void)
+	{
+		bool Written = !ferror(File) && (fflush(File) == 0) && (fsync(fileno(File)) == 0);
+		Written = (fclose(File) == 0) && Written;
+		File = nullptr;
+		if (Written && (rename(Temp.c_str(), Path.c_str()) == 0)) return true;
+		remove(Temp.c_str());
+		return false;
+	}
+	
+	void Discard(void)
+	{
+		fclose(File);
+		File = nullptr;
+		remove(Temp.c_str());
+	}
+	
+	FILE *File = nullptr;
+	std::string Path, Temp;
+};
+
+WriteCoreT::WriteCoreT(yajl_gen Base, std::pmr::memory_resource *Resource) : Base(Base), Resource(Resource), Index(nullptr), Stats(nullptr), Depth(0), Open(nullptr) {}
 
-WriteCoreT::~WriteCoreT(void) {}
+WriteCoreT::WriteCoreT(WriteCoreT *Parent) : Base(Parent->Base), Resource(Parent->Resource), Index(nullptr), Stats(Parent->Stats), Depth(Parent->Depth + 1), Open(Parent->Open)
+{
+	++*Open;
+	SERIAL_STAT(
+		++Stats->FramesAllocated;
+		if (Depth > Stats->MaxDepth) Stats->MaxDepth = Depth;)
+}
+
+WriteCoreT::~WriteCoreT(void) { if (Depth > 0) --*Open; }
+
+//----------------------------------------------------------------------------------------------------------------
+// Top level array index
+// Format: magic, stride, an offset for every stride'th element, element count.  Integers are 64 bit native order.
+static char const IndexMagic[8] = {'S', 'J', 'I', 'D', 'X', '0', '0', '1'};
+
+struct TopWriteCoreT;
+struct WriteIndexT
+{
+	WriteIndexT(TopWriteCoreT &Top, TempFileT const &Target, uint64_t Stride) : Top(Top), Target(Target), Stride(Stride), Elements(0)
+	{
+		Failed = 
+			(fwrite(IndexMagic, sizeof(IndexMagic), 1, Target.File) != 1) || 
+			(fwrite(&Stride, sizeof(Stride), 1, Target.File) != 1);
+	}
+	
+	~WriteIndexT(void) { Finish(); }
+	
+	void Element(void); // Call before each element is generated
+	
+	WriteErrorT Finish(void)
+	{
+		if (!Target.File) return {};
+		Failed = (fwrite(&Elements, sizeof(Elements), 1, Target.File) != 1) || Failed;
+		if (Failed) Target.Discard();
+		if (Failed || !Target.Replace()) return (::StringT() << "Error writing index " << Target.Path << ".").str();
+		return {};
+	}
+	
+	TopWriteCoreT &Top;
+	TempFileT Target;
+	uint64_t const Stride;
+	uint64_t Elements;
+	bool Failed;
+};
 
 //----------------------------------------------------------------------------------------------------------------
 // Array writer
 struct WriteArrayCoreT : WriteCoreT
 {
-	WriteArrayCoreT(yajl_gen Base) : WriteCoreT(Base) { Assert(Base); yajl_gen_array_open(Base); }
+	WriteArrayCoreT(WriteCoreT *Parent) : WriteCoreT(Parent) { Assert(Base); yajl_gen_array_open(Base); SERIAL_STAT(++Stats->Arrays;) }
 	~WriteArrayCoreT(void) { yajl_gen_array_close(Base); }
 };
 
@@ -71,21 +678,23 @@ WriteArrayT::WriteArrayT(WriteArrayT &&Other) : ParentCore(Other.ParentCore), Co
 	Other.ParentCore = nullptr;
 }
 
-void WriteArrayT::Bool(bool const &Value) { Assert(Core->Base); if (Core->Base) yajl_gen_bool(Core->Base, Value); }
+void WriteArrayT::Bool(bool const &Value) { Assert(Core->Base); if (Core->Index) Core->Index->Element(); if (Core->Base) yajl_gen_bool(Core->Base, Value); SERIAL_STAT(++Core->Stats->Values;) }
 
-void WriteArrayT::Int(int64_t const &Value) { Assert(Core->Base); if (Core->Base) yajl_gen_integer(Core->Base, Value); }
+void WriteArrayT::Int(int64_t const &Value) { Assert(Core->Base); if (Core->Index) Core->Index->Element(); if (Core->Base) yajl_gen_integer(Core->Base, Value); SERIAL_STAT(++Core->Stats->Values;) }
 
-void WriteArrayT::UInt(uint64_t const &Value) { Assert(Core->Base); if (Core->Base) yajl_gen_integer(Core->Base, Value); }
+void WriteArrayT::UInt(uint64_t const &Value) { Assert(Core->Base); if (Core->Index) Core->Index->Element(); if (Core->Base) yajl_gen_integer(Core->Base, Value); SERIAL_STAT(++Core->Stats->Values;) }
 
-void WriteArrayT::Float(float const &Value) { Assert(Core->Base); if (Core->Base) yajl_gen_double(Core->Base, Value); }
+void WriteArrayT::Float(float const &Value) { Assert(Core->Base); if (Core->Index) Core->Index->Element(); if (Core->Base) yajl_gen_double(Core->Base, Value); SERIAL_STAT(++Core->Stats->Values;) }
 
 void WriteArrayT::String(std::string const &Value) 
 {
 	Assert(Core->Base); 
 	if (Core->Base) 
 	{
-		auto Temp = ToString(Value);
+		if (Core->Index) Core->Index->Element();
+		auto Temp = ToString(Value, Core->Resource);
 		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char *>(&Temp[0]), Temp.size()); 
+		SERIAL_STAT(++Core->Stats->Values;)
 	}
 }
 
@@ -94,24 +703,60 @@ void WriteArrayT::Binary(uint8_t const *Bytes, size_t const Length)
 	Assert(Core->Base); 
 	if (Core->Base) 
 	{
-		auto Temp = ToBinary(Bytes, Length);
+		if (Core->Index) Core->Index->Element();
+		auto Temp = ToBinary(Bytes, Length, Core->Resource);
 		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char *>(&Temp[0]), Temp.size()); 
+		SERIAL_STAT(++Core->Stats->Values;)
 	}
 }
 
-WriteObjectT WriteArrayT::Object(void) { return WriteObjectT(Core); }
+WriteObjectT WriteArrayT::Object(void) { if (Core->Index) Core->Index->Element(); return WriteObjectT(Core); }
 
-WriteArrayT WriteArrayT::Array(void) { return WriteArrayT(Core); }
+WriteArrayT WriteArrayT::Array(void) { if (Core->Index) Core->Index->Element(); return WriteArrayT(Core); }
 		
-WritePrepolymorphT WriteArrayT::Polymorph(void) { return WritePrepolymorphT(Core); }
+WritePrepolymorphT WriteArrayT::Polymorph(void) { if (Core->Index) Core->Index->Element(); return WritePrepolymorphT(Core); }
+
+void WriteArrayT::Object(WriteCacheT &Cache, std::string const &ID, uint64_t Version, std::function<void(WriteObjectT &Object)> const &Write)
+{
+	if (!Core->Base) { Assert(false); return; }
+	auto const &Bytes = Cache.Fetch(Core, ID, Version, [&Write](std::shared_ptr<WriteCoreT> const &Core) 
+	{ 
+		WriteObjectT Object(Core); 
+		Write(Object); 
+	});
+	if (Core->Index) Core->Index->Element();
+	yajl_gen_number(Core->Base, Bytes.c_str(), Bytes.length());
+}
+
+void WriteArrayT::Array(WriteCacheT &Cache, std::string const &ID, uint64_t Version, std::function<void(WriteArrayT &Array)> const &Write)
+{
+	if (!Core->Base) { Assert(false); return; }
+	auto const &Bytes = Cache.Fetch(Core, ID, Version, [&Write](std::shared_ptr<WriteCoreT> const &Core) 
+	{ 
+		WriteArrayT Array(Core); 
+		Write(Array); 
+	});
+	if (Core->Index) Core->Index->Element();
+	yajl_gen_number(Core->Base, Bytes.c_str(), Bytes.length());
+}
 
-WriteArrayT::WriteArrayT(std::shared_ptr<WriteCoreT> ParentCore) : ParentCore(ParentCore), Core(std::make_shared<WriteArrayCoreT>(ParentCore->Base)) {}
+WriteArrayT::WriteArrayT(std::shared_ptr<WriteCoreT> ParentCore) : ParentCore(ParentCore), Core(std::allocate_shared<WriteArrayCoreT>(std::pmr::polymorphic_allocator<WriteArrayCoreT>(ParentCore->Resource), ParentCore.get())) {}
+
+void WriteArrayT::TaggedString(std::string const &Tagged)
+{
+	Assert(Core->Base); 
+	if (Core->Base) 
+	{
+		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Tagged.c_str()), Tagged.length()); 
+		SERIAL_STAT(++Core->Stats->Values;)
+	}
+}
 
 //----------------------------------------------------------------------------------------------------------------
 // Object writer
 struct WriteObjectCoreT : WriteCoreT
 {
-	WriteObjectCoreT(yajl_gen Base) : WriteCoreT(Base) { yajl_gen_map_open(Base); }
+	WriteObjectCoreT(WriteCoreT *Parent) : WriteCoreT(Parent) { yajl_gen_map_open(Base); SERIAL_STAT(++Stats->Objects;) }
 	~WriteObjectCoreT(void) { yajl_gen_map_close(Base); }
 };
 
@@ -123,6 +768,7 @@ void WriteObjectT::Bool(std::string const &Key, bool const &Value)
 	{
 		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
 		yajl_gen_bool(Core->Base, Value); 
+		SERIAL_STAT(++Core->Stats->Keys; ++Core->Stats->Values;)
 	} 
 	else Assert(false);
 }
@@ -133,6 +779,7 @@ void WriteObjectT::Int(std::string const &Key, int64_t const &Value)
 	{
 		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
 		yajl_gen_integer(Core->Base, Value); 
+		SERIAL_STAT(++Core->Stats->Keys; ++Core->Stats->Values;)
 	} 
 	else Assert(false);
 }
@@ -143,6 +790,7 @@ void WriteObjectT::UInt(std::string const &Key, uint64_t const &Value)
 	{
 		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
 		yajl_gen_integer(Core->Base, Value); 
+		SERIAL_STAT(++Core->Stats->Keys; ++Core->Stats->Values;)
 	} 
 	else Assert(false);
 }
@@ -153,6 +801,7 @@ void WriteObjectT::Float(std::string const &Key, float const &Value)
 	{
 		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
 		yajl_gen_double(Core->Base, Value); 
+		SERIAL_STAT(++Core->Stats->Keys; ++Core->Stats->Values;)
 	} 
 	else Assert(false);
 }
@@ -162,8 +811,9 @@ void WriteObjectT::String(std::string const &Key, std::string const &Value)
 	if (Core->Base) 
 	{
 		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
-		auto Temp = ToString(Value);
+		auto Temp = ToString(Value, Core->Resource);
 		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char *>(&Temp[0]), Temp.size()); 
+		SERIAL_STAT(++Core->Stats->Keys; ++Core->Stats->Values;)
 	} 
 	else Assert(false);
 }
@@ -173,34 +823,144 @@ void WriteObjectT::Binary(std::string const &Key, uint8_t const *Bytes, size_t c
 	if (Core->Base) 
 	{
 		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
-		auto Temp = ToBinary(Bytes, Length);
+		auto Temp = ToBinary(Bytes, Length, Core->Resource);
 		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char *>(&Temp[0]), Temp.size()); 
+		SERIAL_STAT(++Core->Stats->Keys; ++Core->Stats->Values;)
 	} 
 	else Assert(false);
 }
 
 WriteObjectT WriteObjectT::Object(std::string const &Key)
 { 
-	if (Core->Base) yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
+	if (Core->Base) 
+	{
+		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
+		SERIAL_STAT(++Core->Stats->Keys;)
+	}
 	else Assert(false);
 	return WriteObjectT(Core);
 }
 
 WriteArrayT WriteObjectT::Array(std::string const &Key)
 { 
-	if (Core->Base) yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
+	if (Core->Base) 
+	{
+		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
+		SERIAL_STAT(++Core->Stats->Keys;)
+	}
 	else Assert(false);
 	return WriteArrayT(Core);
 }
 
 WritePrepolymorphT WriteObjectT::Polymorph(std::string const &Key) 
 { 
-	if (Core->Base) yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
+	if (Core->Base) 
+	{
+		yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
+		SERIAL_STAT(++Core->Stats->Keys;)
+	}
 	else Assert(false);
 	return WritePrepolymorphT(Core); 
 }
 
-WriteObjectT::WriteObjectT(std::shared_ptr<WriteCoreT> ParentCore) : ParentCore(ParentCore), Core(std::make_shared<WriteObjectCoreT>(ParentCore->Base)) {}
+void WriteObjectT::Object(std::string const &Key, WriteCacheT &Cache, std::string const &ID, uint64_t Version, std::function<void(WriteObjectT &Object)> const &Write)
+{
+	if (!Core->Base) { Assert(false); return; }
+	auto const &Bytes = Cache.Fetch(Core, ID, Version, [&Write](std::shared_ptr<WriteCoreT> const &Core) 
+	{ 
+		WriteObjectT Object(Core); 
+		Write(Object); 
+	});
+	yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
+	yajl_gen_number(Core->Base, Bytes.c_str(), Bytes.length());
+	SERIAL_STAT(++Core->Stats->Keys;)
+}
+
+void WriteObjectT::Array(std::string const &Key, WriteCacheT &Cache, std::string const &ID, uint64_t Version, std::function<void(WriteArrayT &Array)> const &Write)
+{
+	if (!Core->Base) { Assert(false); return; }
+	auto const &Bytes = Cache.Fetch(Core, ID, Version, [&Write](std::shared_ptr<WriteCoreT> const &Core) 
+	{ 
+		WriteArrayT Array(Core); 
+		Write(Array); 
+	});
+	yajl_gen_string(Core->Base, reinterpret_cast<unsigned char const *>(Key.c_str()), Key.length());
+	yajl_gen_number(Core->Base, Bytes.c_str(), Bytes.length());
+	SERIAL_STAT(++Core->Stats->Keys;)
+}
+
+//----------------------------------------------------------------------------------------------------------------
+// Subtree cache
+// Generates a cached subtree on its own yajl generator, so its bytes can be stored and spliced into this and later
+// documents.  yajl writes number text verbatim, which is what the splicing uses.
+struct CacheWriteCoreT : WriteCoreT
+{
+	CacheWriteCoreT(WriteCoreT *Parent) : WriteCoreT(Parent), Allocator(Resource)
+	{
+		auto AllocFuncs = Allocator.Funcs();
+		Base = yajl_gen_alloc(&AllocFuncs);
+		yajl_gen_config(Base, yajl_gen_beautify, 1);
+	}
+	~CacheWriteCoreT(void) { yajl_gen_free(Base); }
+	
+	YAJLAllocatorT Allocator;
+};
+
+std::string const &WriteCacheT::Fetch(std::shared_ptr<WriteCoreT> const &Parent, std::string const &ID, uint64_t Version, 
+	std::function<void(std::shared_ptr<WriteCoreT> const &Core)> const &Generate)
+{
+	auto &Entry = Entries[ID];
+	if (!Generating.empty()) Generating.back()->Children.push_back(ID);
+	if (Entry.Written && (Entry.Version == Version))
+	{
+		Use(Entry);
+		SERIAL_STAT(++Parent->Stats->CacheHits;)
+		return Entry.Bytes;
+	}
+	Entry.Used = true;
+	Entry.Children.clear();
+	auto Core = std::allocate_shared<CacheWriteCoreT>(std::pmr::polymorphic_allocator<CacheWriteCoreT>(Parent->Resource), Parent.get());
+	Generating.push_back(&Entry);
+	Generate(Core);
+	Generating.pop_back();
+	unsigned char const *Buffer = nullptr;
+	size_t Length = 0;
+	auto const Status = yajl_gen_get_buf(Core->Base, &Buffer, &Length);
+	Assert(Status == yajl_gen_status_ok);
+	while (Length && ((Buffer[Length - 1] == '\n') || (Buffer[Length - 1] == ' '))) --Length; // yajl ends a beautified document with a newline
+	Entry.Bytes.assign(reinterpret_cast<char const *>(Buffer), Length);
+	Entry.Version = Version;
+	Entry.Written = true;
+	return Entry.Bytes;
+}
+
+void WriteCacheT::Use(EntryT &Entry)
+{
+	if (Entry.Used) return; // Its subtrees were marked with it
+	Entry.Used = true;
+	for (auto const &ID : Entry.Children)
+	{
+		auto Child = Entries.find(ID);
+		if (Child != Entries.end()) Use(Child->second);
+	}
+}
+
+void WriteCacheT::Prune(void)
+{
+	for (auto Entry = Entries.begin(); Entry != Entries.end();)
+	{
+		if (!Entry->second.Used) Entry = Entries.erase(Entry);
+		else 
+		{
+			Entry->second.Used = false;
+			++Entry;
+		}
+	}
+}
+
+void WriteCacheT::Clear(void) { Entries.clear(); }
+
+WriteObjectT::WriteObjectT(std::shared_ptr<WriteCoreT> ParentCore) : ParentCore(ParentCore), Core(std::allocate_shared<WriteObjectCoreT>(std::pmr::polymorphic_allocator<WriteObjectCoreT>(ParentCore->Resource), ParentCore.get())) {}
 	
 //----------------------------------------------------------------------------------------------------------------
 // Polymorph writer
@@ -210,6 +970,12 @@ WritePolymorphInjectT::WritePolymorphInjectT(std::string const &Tag, WriteArrayT
 {
 	Array.String(Tag);
 }
+
+WritePolymorphInjectT::WritePolymorphInjectT(PolymorphRegistryT const &Registry, PolymorphIDT Type, WriteArrayT &Array)
+{
+	Assert(Type < Registry.Entries.size());
+	Array.TaggedString(Registry.Entries[Type].WriteTag);
+}
 		
 WritePolymorphT::WritePolymorphT(std::string const &Tag, WritePrepolymorphT &&Other) :
 	WriteArrayT(std::move(static_cast<WriteArrayT &&>(Other))),
@@ -217,6 +983,12 @@ WritePolymorphT::WritePolymorphT(std::string const &Tag, WritePrepolymorphT &&Ot
 	WriteObjectT(WriteArrayT::Object())
 	{}
 
+WritePolymorphT::WritePolymorphT(PolymorphRegistryT const &Registry, PolymorphIDT Type, WritePrepolymorphT &&Other) :
+	WriteArrayT(std::move(static_cast<WriteArrayT &&>(Other))),
+	WritePolymorphInjectT(Registry, Type, *this),
+	WriteObjectT(WriteArrayT::Object())
+	{}
+
 WritePolymorphT::WritePolymorphT(WritePolymorphT &&Other) : 
 	WriteArrayT(std::move(static_cast<WriteArrayT &>(Other))),
 	WriteObjectT(std::move(static_cast<WriteObjectT &>(Other)))
@@ -226,65 +998,278 @@ WritePolymorphT::WritePolymorphT(WritePolymorphT &&Other) :
 // Writing start point
 struct TopWriteCoreT : WriteCoreT
 {
-	TopWriteCoreT(void) : WriteCoreT(yajl_gen_alloc(nullptr)) { }
-	~TopWriteCoreT(void) { yajl_gen_free(Base); }
+	TopWriteCoreT(std::pmr::memory_resource *Upstream) : 
+		WriteCoreT(nullptr, Upstream), 
+		Counting(Upstream, Counters.Allocations), 
+		Allocator(SERIAL_STAT_ELSE(&Counting, Upstream)),
+		Buffer(SERIAL_STAT_ELSE(&Counting, Upstream))
+	{
+		SERIAL_STAT(
+			Stats = &Counters;
+			Resource = &Counting;)
+		Open = &OpenScopes;
+		auto AllocFuncs = Allocator.Funcs();
+		Base = yajl_gen_alloc(&AllocFuncs);
+		// yajl frees the previous print context when this is set, so it's set once and switches on Output
+		yajl_gen_config(Base, yajl_gen_print_callback, static_cast<yajl_print_t>([](void *Context, char const *Text, size_t Length)
+		{
+			auto This = reinterpret_cast<TopWriteCoreT *>(Context);
+			if (This->Output)
+			{
+				This->Flushed += Length;
+				SERIAL_STAT(This->Counters.BytesOut += Length;)
+				This->Output->Write(reinterpret_cast<uint8_t const *>(Text), Length);
+			}
+			else if (!This->Streaming) This->Buffer.append(Text, Length); // Dropped if the file couldn't be opened
+		}), this);
+	}
+	~TopWriteCoreT(void) 
+	{ 
+		Finish();
+		yajl_gen_free(Base); 
+	}
+	
+	WriteErrorT Finish(void)
+	{
+		if (Finished) return Error;
+		Finished = true;
+		if (Output && !Output->Finish() && !Error) Error = (::StringT() << "Error writing " << Target.Path << ".").str();
+		Output.reset();
+		if (Target.File)
+		{
+			if (Error) Target.Discard();
+			else if (!Target.Replace()) Error = (::StringT() << "Error writing " << Target.Path << ".").str();
+		}
+		if (Indexer)
+		{
+			auto IndexError = Indexer->Finish();
+			if (!Error) Error = IndexError;
+			Indexer.reset();
+		}
+		return Error;
+	}
+	
+	// Bytes generated so far, including those already dumped or streamed
+	uint64_t Offset(void) { return Flushed + Buffer.size(); }
+	
+	void Stream(CompressionT Compression)
+	{
+		this->Compression = Compression;
+		auto Sink = FileSink(Target.File);
+		if (Compression != CompressionT::None)
+		{
+			auto Encoder = std::make_shared<EncodeT>(Sink, Compression, Resource);
+			Sink = [Encoder](uint8_t const *Bytes, size_t Length) { return Encoder->Write(Bytes, Length); };
+		}
+		Output = std::make_unique<WriteBehindT>(Sink, Resource);
+	}
+	
+	WriteStatsT Counters;
+	CountingResourceT Counting;
+	YAJLAllocatorT Allocator;
+	size_t OpenScopes = 0;
+	bool Streaming = false;
+	TempFileT Target;
+	CompressionT Compression = CompressionT::None;
+	std::unique_ptr<WriteBehindT> Output;
+	std::pmr::string Buffer; // Unless streaming; handed out by Dump
+	uint64_t Flushed = 0;
+	std::unique_ptr<WriteIndexT> Indexer;
+	bool Finished = false;
+	WriteErrorT Error;
 };
 
-WriteT::WriteT(void) : Core(std::make_shared<TopWriteCoreT>())
+void WriteIndexT::Element(void)
+{
+	if (Elements % Stride == 0) 
+	{
+		auto Offset = Top.Offset();
+		if (fwrite(&Offset, sizeof(Offset), 1, Target.File) != 1) Failed = true;
+	}
+	++Elements;
+}
+
+WriteT::WriteT(std::pmr::memory_resource *Resource) : Core(std::allocate_shared<TopWriteCoreT>(std::pmr::polymorphic_allocator<TopWriteCoreT>(Resource), Resource))
 {
 	yajl_gen_config(Core->Base, yajl_gen_beautify, 1);
 }
 
+WriteT::WriteT(Filesystem::PathT const &Path, CompressionT Compression, std::pmr::memory_resource *Resource) : WriteT(Resource)
+{
+	auto Top = static_cast<TopWriteCoreT *>(Core.get());
+	Top->Streaming = true;
+	if (!CompressionSupported(Compression)) 
+	{
+		Top->Error = (::StringT() << "Unable to write " << Path->Render() << ": compression isn't supported.").str();
+		return;
+	}
+	if (!Top->Target.Open(Path->Render())) 
+	{
+		Top->Error = (::StringT() << "Unable to open file " << Path->Render() << " to write.").str();
+		return;
+	}
+	Top->Stream(Compression);
+}
+
+WriteErrorT WriteT::Index(Filesystem::PathT const &IndexPath, size_t Stride)
+{
+	auto Top = static_cast<TopWriteCoreT *>(Core.get());
+	if (!Assert(Top->Compression == CompressionT::None)) return std::string("Compressed documents can't be indexed.");
+	if (!Assert(Stride > 0)) return std::string("Index stride must be at least 1.");
+	if (!Assert(!Top->Indexer && !Top->Finished)) return std::string("Document is already indexed or finished.");
+	TempFileT Target;
+	if (!Target.Open(IndexPath->Render())) return (::StringT() << "Unable to open file " << IndexPath->Render() << " to write.").str();
+	Top->Indexer = std::make_unique<WriteIndexT>(*Top, Target, Stride);
+	return {};
+}
+
 WriteObjectT WriteT::Object(void)
 {
 	return WriteObjectT(Core);
 }
 
+WriteArrayT WriteT::Array(void)
+{
+	WriteArrayT Out(Core);
+	Out.Core->Index = static_cast<TopWriteCoreT *>(Core.get())->Indexer.get();
+	return Out;
+}
+
 std::string WriteT::Dump(void)
 {
 	Assert(Core);
 	if (!Core) return {};
-	unsigned char const *YAJLBuffer;
-	size_t YAJLBufferLength;
-	yajl_gen_get_buf(Core->Base, &YAJLBuffer, &YAJLBufferLength);
-	std::string Out(reinterpret_cast<char const *>(YAJLBuffer), YAJLBufferLength);
-	yajl_gen_clear(Core->Base);
+	auto Top = static_cast<TopWriteCoreT *>(Core.get());
+	if (!Assert(!Top->Streaming)) return {};
+	std::string Out(Top->Buffer.data(), Top->Buffer.size());
+	Top->Flushed += Top->Buffer.size();
+	SERIAL_STAT(Core->Stats->BytesOut += Top->Buffer.size();)
+	Top->Buffer.clear();
 	return Out;
 }
 
-void WriteT::Dump(Filesystem::PathT const &Path)
+void WriteT::Dump(std::pmr::string &Out)
+{
+	Out.clear();
+	Assert(Core);
+	if (!Core) return;
+	auto Top = static_cast<TopWriteCoreT *>(Core.get());
+	if (!Assert(!Top->Streaming)) return;
+	Top->Flushed += Top->Buffer.size();
+	SERIAL_STAT(Core->Stats->BytesOut += Top->Buffer.size();)
+	// Asked of the buffer's resource, since only the counting resource knows it's equal to its upstream
+	if (Top->Buffer.get_allocator().resource()->is_equal(*Out.get_allocator().resource())) Out.swap(Top->Buffer);
+	else 
+	{
+		Out.assign(Top->Buffer);
+		Top->Buffer.clear();
+	}
+}
+
+bool WriteT::Reset(void)
+{
+	auto Top = static_cast<TopWriteCoreT *>(Core.get());
+	if (Top->OpenScopes || Top->Streaming || Top->Indexer) return false;
+	yajl_gen_reset(Core->Base, nullptr);
+	Top->Buffer.clear();
+	Top->Flushed = 0;
+	Top->Finished = false;
+	Top->Error.Unset();
+	SERIAL_STAT(Top->Counters = {};)
+	return true;
+}
+
+WriteErrorT WriteT::Dump(Filesystem::PathT const &Path, CompressionT Compression)
+{
+	if (!CompressionSupported(Compression)) 
+		return (::StringT() << "Unable to write " << Path->Render() << ": compression isn't supported.").str();
+	auto Top = static_cast<TopWriteCoreT *>(Core.get());
+	if (Top->Streaming) return (::StringT() << "Unable to write " << Path->Render() << ": the document is streamed to its own file.").str();
+	if (!Assert(!Top->Indexer || (Compression == CompressionT::None))) 
+		return std::string("Indexed documents can't be compressed.");
+	std::pmr::string String(Core->Resource);
+	Dump(String);
+	TempFileT Target;
+	if (!Target.Open(Path->Render())) return (::StringT() << "Unable to open file " << Path->Render() << " to write.").str();
+	bool Written;
+	if (Compression == CompressionT::None) Written = String.empty() || (fwrite(String.c_str(), String.size(), 1, Target.File) == 1);
+	else
+	{
+		EncodeT Encoder(FileSink(Target.File), Compression, Core->Resource);
+		Written = Encoder.Write(reinterpret_cast<uint8_t const *>(String.c_str()), String.size()) && Encoder.Write(nullptr, 0);
+	}
+	if (!Written) Target.Discard();
+	if (!Written || !Target.Replace()) return (::StringT() << "Error writing " << Path->Render() << ".").str();
+	return {};
+}
+
+WriteErrorT WriteT::Finish(void)
+{
+	auto Top = static_cast<TopWriteCoreT *>(Core.get());
+	if (Top->OpenScopes) return std::string("Objects or arrays are still open.");
+	return Top->Finish();
+}
+
+WriteStatsT const &WriteT::Stats(void) const { return static_cast<TopWriteCoreT *>(Core.get())->Counters; }
+
+//----------------------------------------------------------------------------------------------------------------
+// Writer pool
+WritePoolT::WritePoolT(size_t Capacity) : Capacity(Capacity) {}
+
+WritePoolT::LeaseT WritePoolT::Acquire(void)
+{
+	if (Free.empty()) return LeaseT(new WriteT(), ReturnT{this});
+	auto Writer = Free.back().release();
+	Free.pop_back();
+	return LeaseT(Writer, ReturnT{this});
+}
+
+void WritePoolT::ReturnT::operator()(WriteT *Writer) const
 {
-	auto String = Dump();
-	auto File = fopen(Path->Render().c_str(), "w");
-	if (!Assert(File)) return; // TODO Error?
-	fwrite(String.c_str(), String.size(), 1, File);
-	fclose(File);
+	std::unique_ptr<WriteT> Owned(Writer);
+	if (Pool->Free.size() >= Pool->Capacity) return;
+	if (!Owned->Reset()) return; // Still in use by open objects or arrays, or streaming
+	Pool->Free.push_back(std::move(Owned));
+}
+
+WritePoolT &WritePoolT::Local(void)
+{
+	static thread_local WritePoolT Pool;
+	return Pool;
 }
 
 //================================================================================================================
 // Reading
 
-static ReadErrorT ReadNumber(ReadCallbackVariantT &Callback, std::string const &Source, bool Strict = false)
+// Fails unless all of Source is the number, so a fraction or exponent isn't truncated to an integer
+template <typename NumberT> static bool FromNumber(std::string_view Source, NumberT &Value)
+{
+	auto const End = Source.data() + Source.size();
+	auto const Result = std::from_chars(Source.data(), End, Value);
+	return (Result.ec == std::errc()) && (Result.ptr == End);
+}
+
+static ReadErrorT ReadNumber(ReadCallbackVariantT &Callback, std::string_view Source, bool Strict = false)
 {
 	// TODO handle scientific/eX notation somehow?
 	if (Callback.Is<IntCallbackT>())
 	{
 		int64_t Value;
-		if (!(StringT(Source) >> Value)) 
+		if (!FromNumber(Source, Value)) 
 			return (StringT() << "Unable to convert to integer \'" << Source << "\'.").str();
 		return Callback.Get<IntCallbackT>()(Value);
 	}
 	else if (Callback.Is<UIntCallbackT>())
 	{
 		uint64_t Value;
-		if (!(StringT(Source) >> Value)) 
+		if (!FromNumber(Source, Value)) 
 			return (StringT() << "Unable to convert to unsigned integer \'" << Source << "\'.").str();
 		return Callback.Get<UIntCallbackT>()(Value);
 	}
 	else if (Callback.Is<FloatCallbackT>())
 	{
 		float Value;
-		if (!(StringT(Source) >> Value)) 
+		if (!FromNumber(Source, Value)) 
 			return (StringT() << "Unable to convert to float \'" << Source << "\'.").str();
 		return Callback.Get<FloatCallbackT>()(Value);
 	}
@@ -292,14 +1277,24 @@ static ReadErrorT ReadNumber(ReadCallbackVariantT &Callback, std::string const &
 	else return {};
 }
 
-ReadErrorT ReadString(ReadCallbackVariantT &Callback, std::string const &Source, bool Strict = false)
+ReadErrorT ReadString(ReadCallbackVariantT &Callback, std::string_view Source, bool Strict = false)
 {
 	if (Source.substr(0, sizeof(StringPrefix) - 1) == StringPrefix)
 	{
 		if (Callback.Is<StringCallbackT>()) 
-			return Callback.Get<StringCallbackT>()(Source.substr(sizeof(StringPrefix) - 1));
+			return Callback.Get<StringCallbackT>()(std::string(Source.substr(sizeof(StringPrefix) - 1)));
 		else if (Callback.Is<InternalPolymorphCallbackT>())
-			return Callback.Get<InternalPolymorphCallbackT>().StringCallback(Source.substr(sizeof(StringPrefix) - 1));
+			return Callback.Get<InternalPolymorphCallbackT>().StringCallback(std::string(Source.substr(sizeof(StringPrefix) - 1)));
+		else if (Callback.Is<InternalRegistryPolymorphCallbackT>())
+		{
+			auto &Polymorph = Callback.Get<InternalRegistryPolymorphCallbackT>();
+			if (Polymorph.ObjectCallback) return std::string("Multiple types specified for polymorph.");
+			auto Found = Polymorph.Registry->IDs.find(Source);
+			if (Found == Polymorph.Registry->IDs.end()) 
+				return (StringT() << "Unknown polymorph type \'" << Source.substr(sizeof(StringPrefix) - 1) << "\'.").str();
+			Polymorph.ObjectCallback = &Polymorph.Registry->Entries[Found->second].Callback;
+			return {};
+		}
 		else if (Strict) return std::string("Found string element in a restricted context with no string handler.");
 		else return {};
 	}
@@ -332,8 +1327,59 @@ ReadErrorT ReadPolymorph(ReadCallbackVariantT &Callback, ReadArrayT &Array, bool
 	return {};
 }
 
+ReadErrorT ReadRegistryPolymorph(ReadCallbackVariantT &Callback, ReadArrayT &Array)
+{
+	Array.InternalPolymorph(InternalRegistryPolymorphCallbackT{Callback.Get<RegistryPolymorphCallbackT>().Registry, nullptr});
+	return {};
+}
+
+//----------------------------------------------------------------------------------------------------------------
+// Polymorph registry
+PolymorphIDT PolymorphRegistryT::Add(std::string const &Type, LooseObjectCallbackT const &Callback)
+{
+	PolymorphIDT ID = Entries.size();
+	Tags.push_back(StringPrefix + Type);
+	Entries.push_back({Type, Tags.back(), Callback});
+	Assert(IDs.find(Tags.back()) == IDs.end());
+	IDs[Tags.back()] = ID;
+	return ID;
+}
+
+PolymorphIDT PolymorphRegistryT::Add(std::string const &Type, std::string const &CompactTag, LooseObjectCallbackT const &Callback)
+{
+	auto ID = Add(Type, Callback);
+	Tags.push_back(StringPrefix + CompactTag);
+	Entries.back().WriteTag = Tags.back();
+	Assert(IDs.find(Tags.back()) == IDs.end());
+	IDs[Tags.back()] = ID;
+	return ID;
+}
+
+OptionalT<PolymorphIDT> PolymorphRegistryT::Find(std::string const &Type) const
+{
+	auto Found = IDs.find(StringPrefix + Type);
+	if (Found == IDs.end()) return {};
+	return Found->second;
+}
+
+std::string const &PolymorphRegistryT::Type(PolymorphIDT ID) const
+{
+	Assert(ID < Entries.size());
+	return Entries[ID].Type;
+}
+
 ReadNestableT::~ReadNestableT(void) {}
 
+ReadErrorT ReadNestableT::OpenObject(ReadT &Read) { return Object(*Read.Push<ReadObjectT>()); }
+
+ReadErrorT ReadNestableT::OpenArray(ReadT &Read) { return Array(*Read.Push<ReadArrayT>()); }
+
+void ReadNestableT::Nest(ReadT &Read, ReadNestableT &Frame) 
+{ 
+	Read.Stack.emplace(&Frame, ReadT::FrameDeleterT{nullptr, 0, 0}); 
+	SERIAL_STAT(if (Read.Stack.size() - Read.Floor > Read.Counters.MaxDepth) Read.Counters.MaxDepth = Read.Stack.size() - Read.Floor;)
+}
+
 //----------------------------------------------------------------------------------------------------------------
 // Nested array reader
 
@@ -346,10 +1392,12 @@ void ReadArrayT::Binary(LooseBinaryCallbackT const &Callback) { Assert(!this->Ca
 void ReadArrayT::Object(LooseObjectCallbackT const &Callback) { Assert(!this->Callback); this->Callback.Set<ObjectCallbackT>(Callback); }
 void ReadArrayT::Array(LooseArrayCallbackT const &Callback) { Assert(!this->Callback); this->Callback.Set<ArrayCallbackT>(Callback); }
 void ReadArrayT::Polymorph(LoosePolymorphCallbackT const &Callback) { Assert(!this->Callback); this->Callback.Set<PolymorphCallbackT>(Callback); }
+void ReadArrayT::Polymorph(PolymorphRegistryT const &Registry) { Assert(!this->Callback); this->Callback = RegistryPolymorphCallbackT{&Registry}; }
 
 void ReadArrayT::Finally(std::function<ReadErrorT(void)> const &Callback) { Assert(!DestructorCallback); DestructorCallback = Callback; }
 
 void ReadArrayT::InternalPolymorph(InternalPolymorphCallbackT const &Callback) { Assert(!this->Callback); this->Callback = Callback; }
+void ReadArrayT::InternalPolymorph(InternalRegistryPolymorphCallbackT const &Callback) { Assert(!this->Callback); this->Callback = Callback; }
 
 ReadErrorT ReadArrayT::Bool(bool Value) 
 { 
@@ -357,12 +1405,12 @@ ReadErrorT ReadArrayT::Bool(bool Value)
 	else return std::string("Bool element found in array that does not have a bool handler.");
 }
 
-ReadErrorT ReadArrayT::Number(std::string const &Source)
+ReadErrorT ReadArrayT::Number(std::string_view Source)
 {
 	return ReadNumber(Callback, Source, true);
 }
 
-ReadErrorT ReadArrayT::StringOrBinary(std::string const &Source)
+ReadErrorT ReadArrayT::StringOrBinary(std::string_view Source)
 {
 	return ReadString(Callback, Source, true);
 }
@@ -372,16 +1420,24 @@ ReadErrorT ReadArrayT::Object(ReadObjectT &Object)
 	if (Callback.Is<ObjectCallbackT>()) return Callback.Get<ObjectCallbackT>()(std::ref(Object)); 
 	else if (Callback.Is<InternalPolymorphCallbackT>())
 		return Callback.Get<InternalPolymorphCallbackT>().ObjectCallback(std::ref(Object));
+	else if (Callback.Is<InternalRegistryPolymorphCallbackT>())
+	{
+		auto ObjectCallback = Callback.Get<InternalRegistryPolymorphCallbackT>().ObjectCallback;
+		if (!ObjectCallback) return std::string("No type specified for polymorph.");
+		if (!*ObjectCallback) return {};
+		return (*ObjectCallback)(std::ref(Object));
+	}
 	else return std::string("Object element found in array that does not have an object handler.");
 }
 
-ReadErrorT ReadArrayT::Key(std::string const &Value)
+ReadErrorT ReadArrayT::Key(std::string_view Value)
 	{ return std::string("Keys may not appear in arrays."); } // Hopefully yajl will catch this first?
 	
 ReadErrorT ReadArrayT::Array(ReadArrayT &Array)
 { 
 	if (Callback.Is<ArrayCallbackT>()) return Callback.Get<ArrayCallbackT>()(std::ref(Array));
 	else if (Callback.Is<PolymorphCallbackT>()) return ReadPolymorph(Callback, Array, true);
+	else if (Callback.Is<RegistryPolymorphCallbackT>()) return ReadRegistryPolymorph(Callback, Array);
 	else return std::string("Array element found in array that does not have an array handler.");
 }
 
@@ -393,24 +1449,31 @@ ReadErrorT ReadArrayT::Final(void)
 
 //----------------------------------------------------------------------------------------------------------------
 // Nested object reader
+ReadObjectT::ReadObjectT(std::pmr::memory_resource *Resource) : LastKey(Resource), Callbacks(Resource) {}
+
+ReadCallbackVariantT &ReadObjectT::At(std::string const &Key)
+	{ return Callbacks[std::pmr::string(Key, Callbacks.get_allocator())]; }
+
 void ReadObjectT::Bool(std::string const &Key, LooseBoolCallbackT const &Callback) 
-	{ Assert(!Callbacks[Key]); Callbacks[Key].Set<BoolCallbackT>(Callback); }
+	{ auto &Slot = At(Key); Assert(!Slot); Slot.Set<BoolCallbackT>(Callback); }
 void ReadObjectT::Int(std::string const &Key, LooseIntCallbackT const &Callback) 
-	{ Assert(!Callbacks[Key]); Callbacks[Key].Set<IntCallbackT>(Callback); }
+	{ auto &Slot = At(Key); Assert(!Slot); Slot.Set<IntCallbackT>(Callback); }
 void ReadObjectT::UInt(std::string const &Key, LooseUIntCallbackT const &Callback) 
-	{ Assert(!Callbacks[Key]); Callbacks[Key].Set<UIntCallbackT>(Callback); }
+	{ auto &Slot = At(Key); Assert(!Slot); Slot.Set<UIntCallbackT>(Callback); }
 void ReadObjectT::Float(std::string const &Key, LooseFloatCallbackT const &Callback) 
-	{ Assert(!Callbacks[Key]); Callbacks[Key].Set<FloatCallbackT>(Callback); }
+	{ auto &Slot = At(Key); Assert(!Slot); Slot.Set<FloatCallbackT>(Callback); }
 void ReadObjectT::String(std::string const &Key, LooseStringCallbackT const &Callback) 
-	{ Assert(!Callbacks[Key]); Callbacks[Key].Set<StringCallbackT>(Callback); }
+	{ auto &Slot = At(Key); Assert(!Slot); Slot.Set<StringCallbackT>(Callback); }
 void ReadObjectT::Binary(std::string const &Key, LooseBinaryCallbackT const &Callback) 
-	{ Assert(!Callbacks[Key]); Callbacks[Key].Set<BinaryCallbackT>(Callback); }
+	{ auto &Slot = At(Key); Assert(!Slot); Slot.Set<BinaryCallbackT>(Callback); }
 void ReadObjectT::Object(std::string const &Key, LooseObjectCallbackT const &Callback) 
-	{ Assert(!Callbacks[Key]); Callbacks[Key].Set<ObjectCallbackT>(Callback); }
+	{ auto &Slot = At(Key); Assert(!Slot); Slot.Set<ObjectCallbackT>(Callback); }
 void ReadObjectT::Array(std::string const &Key, LooseArrayCallbackT const &Callback) 
-	{ Assert(!Callbacks[Key]); Callbacks[Key].Set<ArrayCallbackT>(Callback); }
+	{ auto &Slot = At(Key); Assert(!Slot); Slot.Set<ArrayCallbackT>(Callback); }
 void ReadObjectT::Polymorph(std::string const &Key, LoosePolymorphCallbackT const &Callback) 
-	{ Assert(!Callbacks[Key]); Callbacks[Key].Set<PolymorphCallbackT>(Callback); }
+	{ auto &Slot = At(Key); Assert(!Slot); Slot.Set<PolymorphCallbackT>(Callback); }
+void ReadObjectT::Polymorph(std::string const &Key, PolymorphRegistryT const &Registry) 
+	{ auto &Slot = At(Key); Assert(!Slot); Slot = RegistryPolymorphCallbackT{&Registry}; }
 
 void ReadObjectT::Finally(std::function<ReadErrorT(void)> const &Callback) { Assert(!DestructorCallback); DestructorCallback = Callback; }
 
@@ -424,7 +1487,7 @@ ReadErrorT ReadObjectT::Bool(bool Value)
 	return {};
 }
 	
-ReadErrorT ReadObjectT::Number(std::string const &Source)
+ReadErrorT ReadObjectT::Number(std::string_view Source)
 { 
 	if (LastKey.empty()) { return std::string("Value with no key in object."); }
 	auto Callback = Callbacks.find(LastKey);
@@ -433,7 +1496,7 @@ ReadErrorT ReadObjectT::Number(std::string const &Source)
 	return ReadNumber(Callback->second, Source);
 }
 
-ReadErrorT ReadObjectT::StringOrBinary(std::string const &Source)
+ReadErrorT ReadObjectT::StringOrBinary(std::string_view Source)
 { 
 	if (LastKey.empty()) { return std::string("Value with no key in object."); }
 	auto Callback = Callbacks.find(LastKey);
@@ -452,7 +1515,7 @@ ReadErrorT ReadObjectT::Object(ReadObjectT &Object)
 	return {};
 }
 
-ReadErrorT ReadObjectT::Key(std::string const &Value) 
+ReadErrorT ReadObjectT::Key(std::string_view Value) 
 { 
 	LastKey = Value; 
 	return {}; 
@@ -472,6 +1535,10 @@ ReadErrorT ReadObjectT::Array(ReadArrayT &Array)
 		{
 			return ReadPolymorph(Callback->second, Array);
 		}
+		else if (Callback->second.Is<RegistryPolymorphCallbackT>())
+		{
+			return ReadRegistryPolymorph(Callback->second, Array);
+		}
 	}
 	LastKey.clear();
 	return {};
@@ -485,9 +1552,51 @@ ReadErrorT ReadObjectT::Final(void)
 
 //----------------------------------------------------------------------------------------------------------------
 // Nested object reader
-ReadT::ReadT(void)
+void ReadT::FrameDeleterT::operator()(ReadNestableT *Frame) const
 {
-	Stack.emplace(this, [](ReadNestableT *){});
+	if (!Resource) return;
+	auto Memory = dynamic_cast<void *>(Frame);
+	Frame->~ReadNestableT();
+	Resource->deallocate(Memory, Size, Alignment);
+}
+
+template <typename NestableT> NestableT *ReadT::Push(void)
+{
+	SERIAL_STAT(++Counters.FramesAllocated;)
+	auto Memory = Resource->allocate(sizeof(NestableT), alignof(NestableT));
+	NestableT *Frame;
+	if constexpr (std::is_constructible<NestableT, std::pmr::memory_resource *>::value) Frame = new (Memory) NestableT(Resource);
+	else Frame = new (Memory) NestableT;
+	Stack.emplace(Frame, FrameDeleterT{Resource, sizeof(NestableT), alignof(NestableT)});
+	SERIAL_STAT(if (Stack.size() - Floor > Counters.MaxDepth) Counters.MaxDepth = Stack.size() - Floor;)
+	return Frame;
+}
+
+bool ReadT::Token(size_t Length)
+{
+	if (Length <= Limits.TokenLength) return true;
+	Error = (StringT() << "Token length " << Length << " exceeds limit of " << Limits.TokenLength << ".").str();
+	return false;
+}
+
+bool ReadT::Element(void)
+{
+	if (++Stack.top().Elements <= Limits.Elements) return true;
+	Error = (StringT() << "Container exceeds element limit of " << Limits.Elements << ".").str();
+	return false;
+}
+
+ReadT::ReadT(std::pmr::memory_resource *Resource) : ReadT(ReadLimitsT(), Resource) {}
+
+ReadT::ReadT(ReadLimitsT const &Limits, std::pmr::memory_resource *Upstream) : 
+	Limits(Limits),
+	Counting(Upstream, Counters.Allocations),
+	Resource(SERIAL_STAT_ELSE(&Counting, Upstream)), 
+	Allocator(Resource), 
+	Stack(std::pmr::deque<LevelT>(Resource)),
+	Floor(1)
+{
+	Stack.emplace(this, FrameDeleterT{nullptr, 0, 0});
 	
 	static auto PrepareUserData = [](void *UserData) -> OptionalT<ReadT *>
 	{
@@ -505,6 +1614,8 @@ ReadT::ReadT(void)
 		{
 			auto This = PrepareUserData(UserData); 
 			Assert(This);
+			SERIAL_STAT(++This->Counters.Bools; StatTimerT Timer(This->Counters.CallbackTime);)
+			if (!This->Element()) return false;
 			auto Error = This->Stack.top()->Bool(Value);
 			if (Error) { This->Error = *Error; return false; }
 			return true;
@@ -515,7 +1626,9 @@ ReadT::ReadT(void)
 		{
 			auto This = PrepareUserData(UserData); 
 			Assert(This);
-			auto Error = This->Stack.top()->Number(std::string(Value, ValueLength));
+			SERIAL_STAT(++This->Counters.Numbers; StatTimerT Timer(This->Counters.CallbackTime);)
+			if (!This->Token(ValueLength) || !This->Element()) return false;
+			auto Error = This->Stack.top()->Number(std::string_view(Value, ValueLength));
 			if (Error) { This->Error = *Error; return false; }
 			return true;
 		},
@@ -523,7 +1636,9 @@ ReadT::ReadT(void)
 		{
 			auto This = PrepareUserData(UserData); 
 			Assert(This);
-			auto Error = This->Stack.top()->StringOrBinary(std::string(reinterpret_cast<char const *>(Value), ValueLength));
+			SERIAL_STAT(++This->Counters.Strings; StatTimerT Timer(This->Counters.CallbackTime);)
+			if (!This->Token(ValueLength) || !This->Element()) return false;
+			auto Error = This->Stack.top()->StringOrBinary(std::string_view(reinterpret_cast<char const *>(Value), ValueLength));
 			if (Error) { This->Error = *Error; return false; }
 			return true;
 		},
@@ -533,18 +1648,25 @@ ReadT::ReadT(void)
 		{
 			auto This = PrepareUserData(UserData); 
 			Assert(This);
-			auto NewTop = new ReadObjectT;
-			//if (!This->Object(*NewTop)) return false;
-			auto Error = This->Stack.top()->Object(*NewTop);
+			SERIAL_STAT(++This->Counters.Objects;)
+			if (!This->Element()) return false;
+			if (This->Stack.size() - This->Floor >= This->Limits.Depth)
+			{
+				This->Error = (StringT() << "Nesting exceeds depth limit of " << This->Limits.Depth << ".").str();
+				return false;
+			}
+			SERIAL_STAT(StatTimerT Timer(This->Counters.CallbackTime);)
+			auto Error = This->Stack.top()->OpenObject(**This);
 			if (Error) { This->Error = *Error; return false; }
-			This->Stack.emplace(NewTop, [](ReadNestableT *Target) { delete Target; });
 			return true;
 		},
 		[](void *UserData, unsigned char const *Key, size_t KeyLength) -> int // Key
 		{
 			auto This = PrepareUserData(UserData); 
 			Assert(This);
-			auto Error = This->Stack.top()->Key(std::string(reinterpret_cast<char const *>(Key), KeyLength));
+			SERIAL_STAT(++This->Counters.Keys; StatTimerT Timer(This->Counters.CallbackTime);)
+			if (!This->Token(KeyLength)) return false;
+			auto Error = This->Stack.top()->Key(std::string_view(reinterpret_cast<char const *>(Key), KeyLength));
 			if (Error) { This->Error = *Error; return false; }
 			return true;
 		},
@@ -552,7 +1674,10 @@ ReadT::ReadT(void)
 		{
 			auto This = PrepareUserData(UserData); 
 			Assert(This);
-			This->Stack.top()->Final(); This->Stack.pop();
+			SERIAL_STAT(StatTimerT Timer(This->Counters.CallbackTime);)
+			auto Error = This->Stack.top()->Final(); 
+			This->Stack.pop();
+			if (Error) { This->Error = *Error; return false; }
 			return true;
 		},
 		
@@ -561,22 +1686,31 @@ ReadT::ReadT(void)
 		{
 			auto This = PrepareUserData(UserData); 
 			Assert(This);
-			auto NewTop = new ReadArrayT;
-			//if (!This->Array(*NewTop)) return false;
-			auto Error = This->Stack.top()->Array(*NewTop);
+			SERIAL_STAT(++This->Counters.Arrays;)
+			if (!This->Element()) return false;
+			if (This->Stack.size() - This->Floor >= This->Limits.Depth)
+			{
+				This->Error = (StringT() << "Nesting exceeds depth limit of " << This->Limits.Depth << ".").str();
+				return false;
+			}
+			SERIAL_STAT(StatTimerT Timer(This->Counters.CallbackTime);)
+			auto Error = This->Stack.top()->OpenArray(**This);
 			if (Error) { This->Error = *Error; return false; }
-			This->Stack.emplace(NewTop, [](ReadNestableT *Target) { delete Target; });
 			return true;
 		},
 		[](void *UserData) -> int // Close
 		{
 			auto This = PrepareUserData(UserData); 
 			Assert(This);
-			This->Stack.top()->Final(); This->Stack.pop();
+			SERIAL_STAT(StatTimerT Timer(This->Counters.CallbackTime);)
+			auto Error = This->Stack.top()->Final(); 
+			This->Stack.pop();
+			if (Error) { This->Error = *Error; return false; }
 			return true;
 		}
 	};
-	Base = yajl_alloc(&Callbacks, NULL, this);  
+	auto AllocFuncs = Allocator.Funcs();
+	Base = yajl_alloc(&Callbacks, &AllocFuncs, this);  
 }
 
 ReadT::~ReadT(void)
@@ -584,76 +1718,532 @@ ReadT::~ReadT(void)
 	yajl_free(Base);
 }
 		
+// Smaller inputs are parsed without starting a read-ahead thread
+static std::streamoff const ReadAheadBytes = ChunkSize * ChunkCount;
+
+// False for pipes and other files without a size
+static bool LongFile(FILE *File)
+{
+	struct stat Status;
+	if ((fstat(fileno(File), &Status) != 0) || !S_ISREG(Status.st_mode)) return false;
+	auto const Start = ftello(File);
+	return (Start >= 0) && (Status.st_size - Start >= ReadAheadBytes);
+}
+
 ReadErrorT ReadT::Parse(Filesystem::PathT const &Path)
 {
-	auto File = fopen(Path->Render().c_str(), "r");
-	if (!File || ferror(File)) return (::StringT() << "Unable to open file " << Path->Render() << " to parse.").str();
-	while (true)
-	{
-		uint8_t ReadBuffer[65536];
-		auto ReadSize = fread(reinterpret_cast<char *>(ReadBuffer), 1, sizeof(ReadBuffer) - 1, File);
-		if (ReadSize == 0)
+	std::unique_ptr<FILE, int(*)(FILE *)> File(fopen(Path->Render().c_str(), "r"), fclose);
+	if (!File || ferror(File.get())) return (::StringT() << "Unable to open file " << Path->Render() << " to parse.").str();
+	return Parse(
+		[&File, &Path](uint8_t *Buffer, size_t Capacity, size_t &Length) -> ReadErrorT
 		{
-			auto Result = yajl_complete_parse(Base);
-			if (Result != yajl_status_ok) goto ReadError;
-			break;
-		}
-		ReadBuffer[ReadSize] = '\0';
+			Length = fread(Buffer, 1, Capacity, File.get());
+			if (ferror(File.get())) return (::StringT() << "Error reading " << Path->Render() << ".").str();
+			return {};
+		}, 
+		" of " + Path->Render(),
+		LongFile(File.get()));
+}
+
+// False if the stream can't seek
+static bool LongStream(std::istream &Stream)
+{
+	auto const Start = Stream.tellg();
+	if (Start == std::istream::pos_type(-1)) return false;
+	Stream.seekg(0, std::ios::end);
+	auto const End = Stream.tellg();
+	if (End == std::istream::pos_type(-1)) Stream.clear();
+	Stream.seekg(Start);
+	return (End != std::istream::pos_type(-1)) && (End - Start >= ReadAheadBytes);
+}
+
+ReadErrorT ReadT::Parse(std::istream &Stream)
+{
+	return Parse(
+		[&Stream](uint8_t *Buffer, size_t Capacity, size_t &Length) -> ReadErrorT
 		{
-			auto Result = yajl_parse(Base, ReadBuffer, ReadSize);
-			if (Result != yajl_status_ok) goto ReadError;
+			Stream.read(reinterpret_cast<char *>(Buffer), Capacity);
+			Length = Stream.gcount();
+			return {};
+		},
+		"",
+		LongStream(Stream));
+}
+
+ReadErrorT ReadT::Parse(ChunkSourceT const &Source, std::string const &Description, bool Background)
+{
+	Error.Unset();
+	uint64_t TotalBytes = 0;
+	auto Decoder = std::make_shared<DecodeT>(Source, Resource);
+	if (!Background)
+	{
+		std::pmr::vector<uint8_t> Buffer(ChunkSize, Resource);
+		while (true)
+		{
+			size_t Length = 0;
+			// One byte is left for a terminator
+			if (auto Error = Decoder->Read(&Buffer[0], Buffer.size() - 1, Length)) 
+				return "Error during JSON deserialization" + Description + ": " + *Error;
+			if (auto Error = Feed(&Buffer[0], Length, TotalBytes, Description)) return Error;
+			if (Length == 0) return {};
 		}
-		
-		continue;
-		ReadError:
+	}
+	
+	ReadAheadT Input([Decoder](uint8_t *Buffer, size_t Capacity, size_t &Length) 
+		{ return Decoder->Read(Buffer, Capacity, Length); }, Resource);
+	while (true)
+	{
+		auto Chunk = Input.Queue.Filled();
+		auto const Length = Chunk->Length;
+		if ((Length == 0) && Input.Error) return "Error during JSON deserialization" + Description + ": " + *Input.Error;
+		if (auto Error = Feed(&Chunk->Data[0], Length, TotalBytes, Description)) return Error;
+		if (Length == 0) return {};
+		Input.Queue.Release(Chunk);
+	}
+}
+
+ReadErrorT ReadT::Feed(uint8_t *Buffer, size_t Length, uint64_t &TotalBytes, std::string const &Description)
+{
+	yajl_status Result;
+	if (Length == 0)
+	{
+		SERIAL_STAT(StatTimerT Timer(Counters.ParseTime);)
+		Result = yajl_complete_parse(Base);
+	}
+	else
+	{
+		Buffer[Length] = '\0';
+		TotalBytes += Length;
+		if (TotalBytes > Limits.Bytes) 
+			return (::StringT() << "Error during JSON deserialization" << Description << ": document exceeds limit of " << Limits.Bytes << " bytes.").str();
+		SERIAL_STAT(Counters.BytesIn += Length;)
+		SERIAL_STAT(StatTimerT Timer(Counters.ParseTime);)
+		Result = yajl_parse(Base, Buffer, Length);
+	}
+	if (Result == yajl_status_ok) return {};
+	
+	auto ErrorMessage = yajl_get_error(Base, 1, Buffer, Length);
+	::StringT Error;
+	Error << "Error during JSON deserialization" << Description << ": ";
+	if (this->Error) Error << *this->Error << "\n";
+	Error << ErrorMessage;
+	yajl_free_error(Base, ErrorMessage);
+	return Error.str();
+}
+
+ReadErrorT ReadT::Parse(std::istream &&Stream) { return Parse(Stream); }
+
+void ReadT::Capture(ReadNestableT &Handler)
+{
+	Assert(Stack.size() == 1);
+	Floor = Stack.size() + 1;
+	Nest(*this, Handler);
+}
+
+ReadStatsT const &ReadT::Stats(void) const { return Counters; }
+
+//================================================================================================================
+// Indexed reading
+
+// Finds the extent of one value in an array, starting anywhere between elements
+struct ElementScanT
+{
+	enum struct ResultT { More, Done, End };
+	
+	ElementScanT(void) { Reset(); }
+	
+	void Reset(void)
+	{
+		Started = false;
+		Scalar = false;
+		InString = false;
+		Escape = false;
+		Depth = 0;
+	}
+	
+	// On Done, Start and End bound the element and Position is just past it.  End means the array closed first.
+	ResultT Scan(std::string const &Buffer, size_t &Position)
+	{
+		for (; Position < Buffer.size(); ++Position)
 		{
-			auto ErrorMessage = yajl_get_error(Base, 1, ReadBuffer, ReadSize);
-			::StringT Error;
-			Error << "Error during JSON deserialization of " << Path->Render() << ": ";
-			if (this->Error) Error << *this->Error << "\n";
-			Error << ErrorMessage;
-			yajl_free_error(Base, ErrorMessage);
-			return Error.str();
+			auto const Byte = Buffer[Position];
+			if (!Started)
+			{
+				if (IsSpace(Byte) || (Byte == ',')) continue;
+				if (Byte == ']') return ResultT::End;
+				Started = true;
+				Start = Position;
+				Scalar = (Byte != '"') && (Byte != '{') && (Byte != '[');
+				if (Scalar) continue;
+			}
+			if (InString)
+			{
+				if (Escape) Escape = false;
+				else if (Byte == '\\') Escape = true;
+				else if (Byte == '"')
+				{
+					InString = false;
+					if (Depth == 0) { End = ++Position; return ResultT::Done; }
+				}
+				continue;
+			}
+			if (Scalar)
+			{
+				if (IsSpace(Byte) || (Byte == ',') || (Byte == ']')) { End = Position; return ResultT::Done; }
+				continue;
+			}
+			switch (Byte)
+			{
+				case '"': InString = true; break;
+				case '{': case '[': ++Depth; break;
+				case '}': case ']': if (--Depth == 0) { End = ++Position; return ResultT::Done; } break;
+				default: break;
+			}
 		}
+		return ResultT::More;
+	}
+	
+	// Called at the end of the input; a number or literal may end there
+	ResultT Finish(size_t Position)
+	{
+		if (!Started || !Scalar) return ResultT::End;
+		End = Position;
+		return ResultT::Done;
 	}
+	
+	size_t Start, End;
+	
+	private:
+		static bool IsSpace(char Byte) { return (Byte == ' ') || (Byte == '\n') || (Byte == '\r') || (Byte == '\t'); }
+		
+		bool Started, Scalar, InString, Escape;
+		size_t Depth;
+};
+
+IndexedReadT::IndexedReadT(void) : File(nullptr), Stride(1), Elements(0) {}
+
+IndexedReadT::~IndexedReadT(void) { if (File) fclose(File); }
+
+ReadErrorT IndexedReadT::Open(Filesystem::PathT const &Path, Filesystem::PathT const &IndexPath)
+{
+	if (File) fclose(File);
+	File = nullptr;
+	Elements = 0;
+	Offsets.clear();
+	
+	std::unique_ptr<FILE, int(*)(FILE *)> Index(fopen(IndexPath->Render().c_str(), "rb"), fclose);
+	if (!Index) return (::StringT() << "Unable to open index " << IndexPath->Render() << ".").str();
+	char Magic[sizeof(IndexMagic)];
+	if ((fread(Magic, sizeof(Magic), 1, Index.get()) != 1) || 
+		(memcmp(Magic, IndexMagic, sizeof(Magic)) != 0) || 
+		(fread(&Stride, sizeof(Stride), 1, Index.get()) != 1) ||
+		(Stride == 0))
+		return (::StringT() << IndexPath->Render() << " is not a document index.").str();
+	auto const HeaderSize = ftello(Index.get());
+	if ((fseeko(Index.get(), 0, SEEK_END) != 0)) return (::StringT() << "Error reading " << IndexPath->Render() << ".").str();
+	auto const Size = ftello(Index.get());
+	if ((Size < HeaderSize + static_cast<off_t>(sizeof(uint64_t))) || ((Size - HeaderSize) % sizeof(uint64_t) != 0)) 
+		return (::StringT() << "Index " << IndexPath->Render() << " is incomplete.").str();
+	std::vector<uint64_t> Entries((Size - HeaderSize) / sizeof(uint64_t));
+	if ((fseeko(Index.get(), HeaderSize, SEEK_SET) != 0) || 
+		(fread(&Entries[0], sizeof(uint64_t), Entries.size(), Index.get()) != Entries.size()))
+		return (::StringT() << "Error reading " << IndexPath->Render() << ".").str();
+	auto const Count = Entries.back();
+	Entries.pop_back();
+	if (Entries.size() != (Count + Stride - 1) / Stride) return (::StringT() << "Index " << IndexPath->Render() << " is incomplete.").str();
+	
+	File = fopen(Path->Render().c_str(), "rb");
+	if (!File) return (::StringT() << "Unable to open file " << Path->Render() << " to parse.").str();
+	this->Path = Path->Render();
+	Elements = Count;
+	Offsets = std::move(Entries);
 	return {};
 }
 
-ReadErrorT ReadT::Parse(std::istream &Stream)
+size_t IndexedReadT::Count(void) const { return Elements; }
+
+ReadErrorT IndexedReadT::Read(size_t Index, ReadT &Read)
 {
-	Error.Unset();
+	if (!Assert(File)) return std::string("No indexed document is open.");
+	if (Index >= Elements) return (::StringT() << "Element " << Index << " is past the end of " << Path << " (" << Elements << " elements).").str();
+	if (fseeko(File, Offsets[Index / Stride], SEEK_SET) != 0) return (::StringT() << "Error reading " << Path << ".").str();
+	Buffer.clear();
+	size_t Position = 0;
+	auto Skip = Index % Stride;
+	ElementScanT Scan;
 	while (true)
 	{
-		uint8_t ReadBuffer[65536];
-		Stream.read(reinterpret_cast<char *>(ReadBuffer), sizeof(ReadBuffer) - 1);
-		auto ReadSize = Stream.gcount();
-		if (ReadSize == 0)
+		auto Result = Scan.Scan(Buffer, Position);
+		if (Result == ElementScanT::ResultT::More)
+		{
+			auto const Had = Buffer.size();
+			Buffer.resize(Had + ChunkSize);
+			auto const Got = fread(&Buffer[Had], 1, ChunkSize, File);
+			Buffer.resize(Had + Got);
+			if (ferror(File)) return (::StringT() << "Error reading " << Path << ".").str();
+			if (Got > 0) continue;
+			Result = Scan.Finish(Position);
+		}
+		if (Result == ElementScanT::ResultT::End) 
+			return (::StringT() << "Element " << Index << " of " << Path << " isn't where its index says it is.").str();
+		if (Skip == 0) break;
+		--Skip;
+		Buffer.erase(0, Position);
+		Position = 0;
+		Scan.Reset();
+	}
+	
+	std::string_view Element(&Buffer[Scan.Start], Scan.End - Scan.Start);
+	return Read.Parse(
+		[&Element](uint8_t *Out, size_t Capacity, size_t &Length) -> ReadErrorT
+		{
+			Length = std::min(Capacity, Element.size());
+			memcpy(Out, Element.data(), Length);
+			Element.remove_prefix(Length);
+			return {};
+		},
+		(::StringT() << " of element " << Index << " of " << Path).str(),
+		false);
+}
+
+//================================================================================================================
+// DOM
+struct DomBuilderT : ReadNestableT
+{
+	DomBuilderT(DomT &Dom) : 
+		Dom(Dom), 
+		LastKey(DomT::NoKey), 
+		Pending(Dom.Arena.upstream_resource()), 
+		Opens(Dom.Arena.upstream_resource()) 
+		{}
+	
+	protected:
+		ReadErrorT Bool(bool Value) override 
+		{ 
+			Dom.Nodes[Add(DomT::TypeT::Bool)].Bool = Value; 
+			return {}; 
+		}
+		
+		ReadErrorT Number(std::string_view Source) override
+		{
+			SetText(Add(DomT::TypeT::Number), Source);
+			return {};
+		}
+		
+		ReadErrorT StringOrBinary(std::string_view Source) override
+		{
+			if (Source.substr(0, sizeof(StringPrefix) - 1) == StringPrefix)
+				SetText(Add(DomT::TypeT::String), Source.substr(sizeof(StringPrefix) - 1));
+			else if (Source.substr(0, sizeof(BinaryPrefix) - 1) == BinaryPrefix)
+				SetText(Add(DomT::TypeT::Binary), Source.substr(sizeof(BinaryPrefix) - 1));
+			else return (StringT() << "Strings must start with utf8: or binary:, unknown tagged string \'" << Source << "\'").str();
+			return {};
+		}
+		
+		ReadErrorT Object(ReadObjectT &Object) override { Assert(false); return {}; }
+		
+		ReadErrorT Key(std::string_view Value) override
+		{
+			auto Found = Dom.KeyIDs.find(Value);
+			if (Found != Dom.KeyIDs.end()) { LastKey = Found->second; return {}; }
+			LastKey = Dom.Keys.size();
+			Dom.Keys.emplace_back(Copy(Value), Value.size());
+			Dom.KeyIDs.emplace(Dom.Keys.back(), LastKey);
+			return {};
+		}
+		
+		ReadErrorT Array(ReadArrayT &Array) override { Assert(false); return {}; }
+		
+		ReadErrorT Final(void) override
+		{
+			auto Open = Opens.back();
+			Opens.pop_back();
+			auto &Node = Dom.Nodes[Open.Node];
+			Node.FirstChild = Dom.Children.size();
+			Node.Length = Pending.size() - Open.FirstPending;
+			Dom.Children.insert(Dom.Children.end(), Pending.begin() + Open.FirstPending, Pending.end());
+			Pending.resize(Open.FirstPending);
+			return {};
+		}
+		
+		ReadErrorT OpenObject(ReadT &Read) override
 		{
-			auto Result = yajl_complete_parse(Base);
-			if (Result != yajl_status_ok) goto ReadError;
-			break;
+			Opens.push_back({Add(DomT::TypeT::Object), 0});
+			Opens.back().FirstPending = Pending.size();
+			Nest(Read, *this);
+			return {};
+		}
+		
+		ReadErrorT OpenArray(ReadT &Read) override
+		{
+			Opens.push_back({Add(DomT::TypeT::Array), 0});
+			Opens.back().FirstPending = Pending.size();
+			Nest(Read, *this);
+			return {};
 		}
-		ReadBuffer[ReadSize] = '\0';
+		
+	private:
+		DomT::NodeIDT Add(DomT::TypeT Type)
 		{
-			auto Result = yajl_parse(Base, ReadBuffer, ReadSize);
-			if (Result != yajl_status_ok) goto ReadError;
+			DomT::NodeIDT ID = Dom.Nodes.size();
+			Dom.Nodes.push_back({});
+			auto &Node = Dom.Nodes.back();
+			Node.Type = Type;
+			Node.Key = (!Opens.empty() && (Dom.Nodes[Opens.back().Node].Type == DomT::TypeT::Object)) ? LastKey : DomT::NoKey;
+			Node.Length = 0;
+			LastKey = DomT::NoKey;
+			Pending.push_back(ID);
+			return ID;
 		}
 		
-		continue;
-		ReadError:
+		char const *Copy(std::string_view Text)
 		{
-			auto ErrorMessage = yajl_get_error(Base, 1, ReadBuffer, ReadSize);
-			::StringT Error;
-			Error << "Error during JSON deserialization: ";
-			if (this->Error) Error << *this->Error << "\n";
-			Error << ErrorMessage;
-			yajl_free_error(Base, ErrorMessage);
-			return Error.str();
+			auto Out = reinterpret_cast<char *>(Dom.Arena.allocate(Text.size() ? Text.size() : 1, 1));
+			memcpy(Out, Text.data(), Text.size());
+			return Out;
 		}
+		
+		void SetText(DomT::NodeIDT ID, std::string_view Text)
+		{
+			auto &Node = Dom.Nodes[ID];
+			Node.Text = Copy(Text);
+			Node.Length = Text.size();
+		}
+		
+		DomT &Dom;
+		uint32_t LastKey;
+		std::pmr::vector<DomT::NodeIDT> Pending; // Children of open containers
+		struct OpenT
+		{
+			DomT::NodeIDT Node;
+			size_t FirstPending;
+		};
+		std::pmr::vector<OpenT> Opens;
+};
+
+DomT::DomT(std::pmr::memory_resource *Upstream) : 
+	Arena(Upstream), 
+	Nodes(&Arena), 
+	Children(&Arena), 
+	Keys(&Arena), 
+	KeyIDs(&Arena) 
+	{}
+
+ReadErrorT DomT::Parse(Filesystem::PathT const &Path, ReadLimitsT const &Limits)
+{
+	Clear();
+	ReadT Read(Limits, Arena.upstream_resource());
+	DomBuilderT Builder(*this);
+	Read.Capture(Builder);
+	auto Error = Read.Parse(Path);
+	if (Error) Clear();
+	return Error;
+}
+
+ReadErrorT DomT::Parse(std::istream &Stream, ReadLimitsT const &Limits)
+{
+	Clear();
+	ReadT Read(Limits, Arena.upstream_resource());
+	DomBuilderT Builder(*this);
+	Read.Capture(Builder);
+	auto Error = Read.Parse(Stream);
+	if (Error) Clear();
+	return Error;
+}
+
+ReadErrorT DomT::Parse(std::istream &&Stream, ReadLimitsT const &Limits) { return Parse(Stream, Limits); }
+
+void DomT::Clear(void)
+{
+	// Drop container storage before releasing the arena it came from
+	decltype(Nodes)(&Arena).swap(Nodes);
+	decltype(Children)(&Arena).swap(Children);
+	decltype(Keys)(&Arena).swap(Keys);
+	decltype(KeyIDs)(&Arena).swap(KeyIDs);
+	Arena.release();
+}
+
+bool DomT::Empty(void) const { return Nodes.empty(); }
+
+DomT::NodeIDT DomT::Root(void) const { Assert(!Nodes.empty()); return 0; }
+
+DomT::TypeT DomT::Type(NodeIDT Node) const { Assert(Node < Nodes.size()); return Nodes[Node].Type; }
+
+size_t DomT::Count(NodeIDT Node) const
+{
+	Assert(Node < Nodes.size());
+	auto const &Found = Nodes[Node];
+	if ((Found.Type != TypeT::Object) && (Found.Type != TypeT::Array)) return 0;
+	return Found.Length;
+}
+
+DomT::NodeIDT DomT::Child(NodeIDT Node, size_t Index) const
+{
+	Assert(Index < Count(Node));
+	return Children[Nodes[Node].FirstChild + Index];
+}
+
+std::string_view DomT::Key(NodeIDT Node) const
+{
+	Assert(Node < Nodes.size());
+	if (Nodes[Node].Key == NoKey) return {};
+	return Keys[Nodes[Node].Key];
+}
+
+OptionalT<DomT::NodeIDT> DomT::Find(NodeIDT Object, std::string_view Key) const
+{
+	Assert(Object < Nodes.size());
+	auto const &Found = Nodes[Object];
+	if (Found.Type != TypeT::Object) return {};
+	auto KeyID = KeyIDs.find(Key);
+	if (KeyID == KeyIDs.end()) return {};
+	for (size_t Index = 0; Index < Found.Length; ++Index)
+	{
+		auto Child = Children[Found.FirstChild + Index];
+		if (Nodes[Child].Key == KeyID->second) return Child;
 	}
 	return {};
 }
 
-ReadErrorT ReadT::Parse(std::istream &&Stream) { return Parse(Stream); }
+bool DomT::Bool(NodeIDT Node) const
+{
+	Assert(Node < Nodes.size());
+	auto const &Found = Nodes[Node];
+	if (Found.Type != TypeT::Bool) return false;
+	return Found.Bool;
+}
+
+template <typename NumberT> static OptionalT<NumberT> DomNumber(DomT::TypeT Type, char const *Text, size_t Length)
+{
+	if (Type != DomT::TypeT::Number) return {};
+	NumberT Value;
+	if (!FromNumber(std::string_view(Text, Length), Value)) return {};
+	return Value;
+}
+
+OptionalT<int64_t> DomT::Int(NodeIDT Node) const
+	{ Assert(Node < Nodes.size()); return DomNumber<int64_t>(Nodes[Node].Type, Nodes[Node].Text, Nodes[Node].Length); }
+
+OptionalT<uint64_t> DomT::UInt(NodeIDT Node) const
+	{ Assert(Node < Nodes.size()); return DomNumber<uint64_t>(Nodes[Node].Type, Nodes[Node].Text, Nodes[Node].Length); }
+
+OptionalT<float> DomT::Float(NodeIDT Node) const
+	{ Assert(Node < Nodes.size()); return DomNumber<float>(Nodes[Node].Type, Nodes[Node].Text, Nodes[Node].Length); }
+
+std::string_view DomT::String(NodeIDT Node) const
+{
+	Assert(Node < Nodes.size());
+	auto const &Found = Nodes[Node];
+	if (Found.Type != TypeT::String) return {};
+	return std::string_view(Found.Text, Found.Length);
+}
+
+std::vector<uint8_t> DomT::Binary(NodeIDT Node) const
+{
+	Assert(Node < Nodes.size());
+	auto const &Found = Nodes[Node];
+	if (Found.Type != TypeT::Binary) return {};
+	return FromBinary(std::string_view(Found.Text, Found.Length));
+}
 
 }
@@ -5,7 +5,14 @@
 #include <yajl/yajl_gen.h>
 
 #include <map>
+#include <unordered_map>
 #include <stack>
+#include <deque>
+#include <string_view>
+#include <memory_resource>
+#include <limits>
+#include <cstdio>
+#include <chrono>
 
 #include "../ren-cxx-basics/type.h"
 #include "../ren-cxx-filesystem/filesystem.h"
@@ -15,12 +22,65 @@ namespace Serial
 
 struct WriteObjectT;
 struct WritePrepolymorphT;
+struct WritePolymorphInjectT;
+struct PolymorphRegistryT;
+typedef size_t PolymorphIDT;
+struct WriteIndexT;
+struct WriteCacheT;
+typedef OptionalT<std::string> WriteErrorT;
+
+// GZip needs SERIAL_GZIP (zlib) and ZStd needs SERIAL_ZSTD (libzstd) defined at build time.  Compressed documents are 
+// detected by their magic bytes when parsing.
+enum struct CompressionT { None, GZip, ZStd };
+bool CompressionSupported(CompressionT Compression);
+
+// Statistics are only counted when the library is built with SERIAL_STATS; otherwise no counting code is compiled and
+// they stay zero.  Class layouts don't depend on the setting, so the library and its users may be built differently.
+struct WriteStatsT
+{
+	uint64_t Values = 0;
+	uint64_t Keys = 0;
+	uint64_t Objects = 0;
+	uint64_t Arrays = 0;
+	uint64_t BytesOut = 0;
+	size_t MaxDepth = 0;
+	uint64_t FramesAllocated = 0;
+	uint64_t Allocations = 0; // Through the writer's memory resource
+	uint64_t CacheHits = 0; // Cached scopes written from stored bytes
+};
+
+// Counts allocations made through it, for the statistics.  Compares equal to its upstream resource.
+struct CountingResourceT : std::pmr::memory_resource
+{
+	CountingResourceT(std::pmr::memory_resource *Upstream, uint64_t &Allocations);
+	std::pmr::memory_resource *Upstream;
+	uint64_t &Allocations;
+	
+	protected:
+		void *do_allocate(size_t Bytes, size_t Alignment) override;
+		void do_deallocate(void *Pointer, size_t Bytes, size_t Alignment) override;
+		bool do_is_equal(std::pmr::memory_resource const &Other) const noexcept override;
+};
+
+// Routes yajl's allocations to a memory resource
+struct YAJLAllocatorT
+{
+	YAJLAllocatorT(std::pmr::memory_resource *Resource);
+	yajl_alloc_funcs Funcs(void);
+	std::pmr::memory_resource *Resource;
+};
 
 struct WriteCoreT
 {
-	WriteCoreT(yajl_gen Base);
+	WriteCoreT(yajl_gen Base, std::pmr::memory_resource *Resource);
+	WriteCoreT(WriteCoreT *Parent);
 	virtual ~WriteCoreT(void);
 	yajl_gen Base;
+	std::pmr::memory_resource *Resource;
+	WriteIndexT *Index; // Set on an indexed top level array
+	WriteStatsT *Stats; // Null unless counting
+	size_t Depth;
+	size_t *Open; // Objects and arrays open in the document, counted at the top
 };
 
 struct WriteArrayT
@@ -40,10 +100,17 @@ struct WriteArrayT
 		WriteObjectT Object(void);
 		WriteArrayT Array(void);
 		WritePrepolymorphT Polymorph(void);
+		// Calls Write only if Cache has no bytes for ID at Version, see WriteCacheT
+		void Object(WriteCacheT &Cache, std::string const &ID, uint64_t Version, std::function<void(WriteObjectT &Object)> const &Write);
+		void Array(WriteCacheT &Cache, std::string const &ID, uint64_t Version, std::function<void(WriteArrayT &Array)> const &Write);
 		
 	friend struct WriteObjectT;
+	friend struct WriteCacheT;
+	friend struct WritePolymorphInjectT;
+	friend struct WriteT;
 	protected:
 		WriteArrayT(std::shared_ptr<WriteCoreT> ParentCore);
+		void TaggedString(std::string const &Tagged);
 		std::shared_ptr<WriteCoreT> ParentCore, Core;
 };
 
@@ -64,9 +131,13 @@ struct WriteObjectT
 		WriteObjectT Object(std::string const &Key);
 		WriteArrayT Array(std::string const &Key);
 		WritePrepolymorphT Polymorph(std::string const &Key);
+		// Calls Write only if Cache has no bytes for ID at Version, see WriteCacheT
+		void Object(std::string const &Key, WriteCacheT &Cache, std::string const &ID, uint64_t Version, std::function<void(WriteObjectT &Object)> const &Write);
+		void Array(std::string const &Key, WriteCacheT &Cache, std::string const &ID, uint64_t Version, std::function<void(WriteArrayT &Array)> const &Write);
 		
 	friend struct WriteArrayT;
 	friend struct WriteT;
+	friend struct WriteCacheT;
 	protected:
 		WriteObjectT(std::shared_ptr<WriteCoreT> ParentCore);
 		std::shared_ptr<WriteCoreT> ParentCore, Core;
@@ -76,6 +147,7 @@ struct WritePrepolymorphT : private WriteArrayT
 {
 	friend struct WriteArrayT;
 	friend struct WriteObjectT;
+	friend struct WritePolymorphT;
 	protected:
 		using WriteArrayT::WriteArrayT;
 
@@ -86,11 +158,13 @@ struct WritePolymorphInjectT // The C++ way: working around initialization synta
 {
 	WritePolymorphInjectT(void);
 	WritePolymorphInjectT(std::string const &Tag, WriteArrayT &Array);
+	WritePolymorphInjectT(PolymorphRegistryT const &Registry, PolymorphIDT Type, WriteArrayT &Array);
 };
 
 struct WritePolymorphT : private WriteArrayT, private WritePolymorphInjectT, WriteObjectT
 {
 	WritePolymorphT(std::string const &Tag, WritePrepolymorphT &&Other);
+	WritePolymorphT(PolymorphRegistryT const &Registry, PolymorphIDT Type, WritePrepolymorphT &&Other);
 	WritePolymorphT(WritePolymorphT &&Other);
 
 	// Screw C++
@@ -105,24 +179,95 @@ struct WritePolymorphT : private WriteArrayT, private WritePolymorphInjectT, Wri
 	using WriteObjectT::Polymorph;
 };
 
+// Serialized subtrees kept between saves of a document, so a save costs in proportion to what changed.  A cached 
+// scope whose ID was last written at the same Version is copied from its stored bytes without calling its writer; 
+// the caller bumps Version (or passes a content hash) whenever anything in the subtree changes.  IDs must be unique
+// within the document.
+struct WriteCacheT
+{
+	public:
+		void Prune(void); // Forgets subtrees not written since the last Prune
+		void Clear(void);
+		
+	friend struct WriteArrayT;
+	friend struct WriteObjectT;
+	private:
+		std::string const &Fetch(std::shared_ptr<WriteCoreT> const &Parent, std::string const &ID, uint64_t Version, 
+			std::function<void(std::shared_ptr<WriteCoreT> const &Core)> const &Generate);
+		struct EntryT
+		{
+			bool Written = false;
+			bool Used = false;
+			uint64_t Version = 0;
+			std::string Bytes;
+			std::vector<std::string> Children; // IDs of cached subtrees spliced into Bytes
+		};
+		void Use(EntryT &Entry); // Marks Entry and its cached subtrees used
+		std::unordered_map<std::string, EntryT> Entries;
+		std::vector<EntryT *> Generating;
+};
+
+// Files are written beside their destination and renamed over it once complete, so an existing document is replaced
+// atomically.
 struct WriteT
 {
-	//WriteT(std::string const &Filename);
-	WriteT(void);
+	WriteT(std::pmr::memory_resource *Resource = std::pmr::get_default_resource());
+	// Streams to Path as the document is built, with file writes on a background thread.  Finish completes the file and
+	// reports whether it was written; otherwise it's completed, unchecked, once the writer and all its objects and arrays
+	// are destroyed.
+	WriteT(
+		Filesystem::PathT const &Path, 
+		CompressionT Compression = CompressionT::None, 
+		std::pmr::memory_resource *Resource = std::pmr::get_default_resource());
+
+	// Records the byte offset of every Stride'th element of the top level array to IndexPath, for IndexedReadT.  Call
+	// before Array().  Not available with compression.
+	WriteErrorT Index(Filesystem::PathT const &IndexPath, size_t Stride = 1);
 
 	WriteObjectT Object(void);
+	WriteArrayT Array(void);
 	std::string Dump(void);
-	void Dump(Filesystem::PathT const &Path);
+	// Swaps the output buffer into Out without copying if Out uses the resource the writer was constructed with, so 
+	// Out's old buffer is reused; otherwise copies.  This holds with SERIAL_STATS too.
+	void Dump(std::pmr::string &Out);
+	WriteErrorT Dump(Filesystem::PathT const &Path, CompressionT Compression = CompressionT::None);
+	// Starts a new document, keeping the generator and buffer.  Returns false and changes nothing if objects or arrays
+	// are still open, or for streaming or indexed writers.
+	bool Reset(void);
+	// Completes the streamed file and the index.  No objects or arrays may be open.  Later calls return the same result.
+	WriteErrorT Finish(void);
+	WriteStatsT const &Stats(void) const;
 
 	private:
 		std::shared_ptr<WriteCoreT> Core;
 };
 
+// Keeps reset writers for reuse, so serializing a response doesn't allocate a generator or regrow a buffer.  A pool
+// isn't thread safe: use Local() for this thread's pool and destroy leases on the thread that acquired them.
+struct WritePoolT
+{
+	public:
+		struct ReturnT
+		{
+			WritePoolT *Pool;
+			void operator()(WriteT *Writer) const;
+		};
+		typedef std::unique_ptr<WriteT, ReturnT> LeaseT; // Returns the writer to the pool when destroyed, if it can be reset
+		
+		WritePoolT(size_t Capacity = 16); // Writers beyond Capacity are freed when returned
+		LeaseT Acquire(void);
+		static WritePoolT &Local(void);
+		
+	private:
+		size_t const Capacity;
+		std::vector<std::unique_ptr<WriteT>> Free;
+};
+
 typedef OptionalT<std::string> ReadErrorT;
 struct ReadArrayT;
 struct ReadObjectT;
+struct ReadT;
 
-// TODO Return ReadErrorT from all callbacks, propagate and halt parsing
 typedef std::function<ReadErrorT(bool Value)> LooseBoolCallbackT;
 typedef std::function<ReadErrorT(int64_t Value)> LooseIntCallbackT;
 typedef std::function<ReadErrorT(uint64_t Value)> LooseUIntCallbackT;
@@ -147,6 +292,15 @@ struct InternalPolymorphCallbackT
 	LooseStringCallbackT StringCallback;
 	LooseObjectCallbackT ObjectCallback;
 };
+struct RegistryPolymorphCallbackT
+{
+	PolymorphRegistryT const *Registry;
+};
+struct InternalRegistryPolymorphCallbackT
+{
+	PolymorphRegistryT const *Registry;
+	LooseObjectCallbackT const *ObjectCallback; // Set once the type element is read
+};
 			
 typedef VariantT
 	<
@@ -159,10 +313,37 @@ typedef VariantT
 		ObjectCallbackT,
 		ArrayCallbackT,
 		PolymorphCallbackT,
-		InternalPolymorphCallbackT
+		InternalPolymorphCallbackT,
+		RegistryPolymorphCallbackT,
+		InternalRegistryPolymorphCallbackT
 	>
 	ReadCallbackVariantT;
 
+// Maps polymorph type tags to ids and object handlers up front, so reading a polymorph is a single hash lookup
+// rather than a type string handed to a callback for comparison.  A type may have a compact tag, which is written
+// in place of the type name; both are accepted when reading.
+struct PolymorphRegistryT
+{
+	public:
+		PolymorphIDT Add(std::string const &Type, LooseObjectCallbackT const &Callback = {});
+		PolymorphIDT Add(std::string const &Type, std::string const &CompactTag, LooseObjectCallbackT const &Callback = {});
+		OptionalT<PolymorphIDT> Find(std::string const &Type) const;
+		std::string const &Type(PolymorphIDT ID) const;
+		
+	friend ReadErrorT ReadString(ReadCallbackVariantT &, std::string_view, bool);
+	friend struct WritePolymorphInjectT;
+	private:
+		struct EntryT
+		{
+			std::string Type;
+			std::string WriteTag; // Prefixed
+			LooseObjectCallbackT Callback;
+		};
+		std::vector<EntryT> Entries;
+		std::deque<std::string> Tags; // Prefixed, backs the keys in IDs
+		std::unordered_map<std::string_view, PolymorphIDT> IDs; // Keyed by prefixed tag, as read
+};
+
 struct ReadNestableT
 {
 	public:
@@ -172,12 +353,17 @@ struct ReadNestableT
 	protected:
 		// Stack context sensitive callbacks
 		virtual ReadErrorT Bool(bool Value) = 0;
-		virtual ReadErrorT Number(std::string const &Source) = 0;
-		virtual ReadErrorT StringOrBinary(std::string const &Source) = 0;
+		virtual ReadErrorT Number(std::string_view Source) = 0;
+		virtual ReadErrorT StringOrBinary(std::string_view Source) = 0;
 		virtual ReadErrorT Object(ReadObjectT &Object) = 0;
-		virtual ReadErrorT Key(std::string const &Value) = 0;
+		virtual ReadErrorT Key(std::string_view Value) = 0;
 		virtual ReadErrorT Array(ReadArrayT &Array) = 0;
 		virtual ReadErrorT Final(void) = 0;
+		
+		// By default nested containers get new ReadObjectT/ReadArrayT frames, which are passed to Object()/Array()
+		virtual ReadErrorT OpenObject(ReadT &Read);
+		virtual ReadErrorT OpenArray(ReadT &Read);
+		static void Nest(ReadT &Read, ReadNestableT &Frame); // Pushes a frame the reader doesn't own
 };
 
 struct ReadArrayT : ReadNestableT
@@ -192,17 +378,20 @@ struct ReadArrayT : ReadNestableT
 		void Object(LooseObjectCallbackT const &Callback);
 		void Array(LooseArrayCallbackT const &Callback);
 		void Polymorph(LoosePolymorphCallbackT const &Callback);
+		void Polymorph(PolymorphRegistryT const &Registry);
 	
 		void Finally(std::function<ReadErrorT(void)> const &Callback);
 	
 	protected:
 		friend ReadErrorT ReadPolymorph(ReadCallbackVariantT &, ReadArrayT &, bool);
+		friend ReadErrorT ReadRegistryPolymorph(ReadCallbackVariantT &, ReadArrayT &);
 		void InternalPolymorph(InternalPolymorphCallbackT const &Callback);
+		void InternalPolymorph(InternalRegistryPolymorphCallbackT const &Callback);
 		ReadErrorT Bool(bool Value) override;
-		ReadErrorT Number(std::string const &Source) override;
-		ReadErrorT StringOrBinary(std::string const &Source) override;
+		ReadErrorT Number(std::string_view Source) override;
+		ReadErrorT StringOrBinary(std::string_view Source) override;
 		ReadErrorT Object(ReadObjectT &Object) override;
-		ReadErrorT Key(std::string const &Value) override;
+		ReadErrorT Key(std::string_view Value) override;
 		ReadErrorT Array(ReadArrayT &Array) override;
 		ReadErrorT Final(void) override;
 	
@@ -214,6 +403,8 @@ struct ReadArrayT : ReadNestableT
 struct ReadObjectT : ReadNestableT
 {
 	public:
+		ReadObjectT(std::pmr::memory_resource *Resource = std::pmr::get_default_resource());
+		
 		void Bool(std::string const &Key, LooseBoolCallbackT const &Callback);
 		void Int(std::string const &Key, LooseIntCallbackT const &Callback);
 		void UInt(std::string const &Key, LooseUIntCallbackT const &Callback);
@@ -223,38 +414,176 @@ struct ReadObjectT : ReadNestableT
 		void Object(std::string const &Key, LooseObjectCallbackT const &Callback);
 		void Array(std::string const &Key, LooseArrayCallbackT const &Callback);
 		void Polymorph(std::string const &Key, LoosePolymorphCallbackT const &Callback);
+		void Polymorph(std::string const &Key, PolymorphRegistryT const &Registry);
 		
 		void Finally(std::function<ReadErrorT(void)> const &Callback);
 		
 	protected:
 		ReadErrorT Bool(bool Value) override;
-		ReadErrorT Number(std::string const &Source) override;
-		ReadErrorT StringOrBinary(std::string const &Source) override;
+		ReadErrorT Number(std::string_view Source) override;
+		ReadErrorT StringOrBinary(std::string_view Source) override;
 		ReadErrorT Object(ReadObjectT &Object) override;
-		ReadErrorT Key(std::string const &Value) override;
+		ReadErrorT Key(std::string_view Value) override;
 		ReadErrorT Array(ReadArrayT &Array) override;
 		ReadErrorT Final(void) override;
 		
 	private:
-		std::string LastKey;
-		std::map<std::string, ReadCallbackVariantT> Callbacks;
+		ReadCallbackVariantT &At(std::string const &Key);
+		std::pmr::string LastKey;
+		std::pmr::map<std::pmr::string, ReadCallbackVariantT> Callbacks;
 		std::function<ReadErrorT(void)> DestructorCallback;
 };
 
+struct ReadStatsT
+{
+	uint64_t Bools = 0;
+	uint64_t Numbers = 0;
+	uint64_t Strings = 0; // Includes binary
+	uint64_t Keys = 0;
+	uint64_t Objects = 0;
+	uint64_t Arrays = 0;
+	uint64_t BytesIn = 0;
+	size_t MaxDepth = 0;
+	uint64_t FramesAllocated = 0;
+	uint64_t Allocations = 0; // Through the reader's memory resource
+	std::chrono::nanoseconds ParseTime{0}; // Total time in yajl, including callbacks
+	std::chrono::nanoseconds CallbackTime{0}; // Time in context handlers and user callbacks
+};
+
+// Parsing stops with an error as soon as any limit is exceeded.  yajl buffers a whole token before reporting it,
+// so Bytes is what bounds memory for a single huge string.
+struct ReadLimitsT
+{
+	size_t Depth = std::numeric_limits<size_t>::max();
+	size_t TokenLength = std::numeric_limits<size_t>::max(); // Bytes in a single string, number or key
+	size_t Elements = std::numeric_limits<size_t>::max(); // Values in a single array or object
+	uint64_t Bytes = std::numeric_limits<uint64_t>::max(); // Total document size
+};
+
 struct ReadT : ReadArrayT
 {
 	public:
-		ReadT(void);
+		ReadT(std::pmr::memory_resource *Resource = std::pmr::get_default_resource());
+		ReadT(ReadLimitsT const &Limits, std::pmr::memory_resource *Resource = std::pmr::get_default_resource());
 		~ReadT(void);
 		ReadErrorT Parse(Filesystem::PathT const &Path);
 		ReadErrorT Parse(std::istream &Stream);
 		ReadErrorT Parse(std::istream &&Stream); // C++ IS SO AWESOME
+		void Capture(ReadNestableT &Handler); // Routes the top level value and everything in it to Handler
+		ReadStatsT const &Stats(void) const;
+	friend struct ReadNestableT;
+	friend struct IndexedReadT;
 	private:
+		struct FrameDeleterT
+		{
+			std::pmr::memory_resource *Resource; // Null if the frame isn't owned
+			size_t Size, Alignment;
+			void operator()(ReadNestableT *Frame) const;
+		};
+		typedef std::unique_ptr<ReadNestableT, FrameDeleterT> FrameT;
+		struct LevelT
+		{
+			LevelT(ReadNestableT *Frame, FrameDeleterT const &Deleter) : Frame(Frame, Deleter), Elements(0) {}
+			ReadNestableT *operator->(void) const { return Frame.get(); }
+			FrameT Frame;
+			size_t Elements; // Per container, even when a handler nests itself for each one
+		};
+		template <typename NestableT> NestableT *Push(void);
+		typedef std::function<ReadErrorT(uint8_t *Buffer, size_t Capacity, size_t &Length)> ChunkSourceT; // Length 0 at end
+		// Reads ahead on a background thread if Background, otherwise reads and parses in turn
+		ReadErrorT Parse(ChunkSourceT const &Source, std::string const &Description, bool Background);
+		// Parses Length bytes, which need room for a terminator after them.  No bytes completes the document.
+		ReadErrorT Feed(uint8_t *Buffer, size_t Length, uint64_t &TotalBytes, std::string const &Description);
+		bool Token(size_t Length);
+		bool Element(void);
+		
+		ReadLimitsT const Limits;
+		ReadStatsT Counters;
+		CountingResourceT Counting;
+		std::pmr::memory_resource *Resource; // Counting when built with SERIAL_STATS
+		YAJLAllocatorT Allocator;
 		yajl_handle Base;
-		std::stack<std::unique_ptr<ReadNestableT, void(*)(ReadNestableT *)>> Stack;
+		std::stack<LevelT, std::pmr::deque<LevelT>> Stack;
+		size_t Floor; // Levels below the document's top value; depth is measured from here
 		ReadErrorT Error;
 };
 
+//================================================================================================================
+// Random access to elements of a large top level array, using the index written by WriteT::Index.  Only the indexed
+// element and at most Stride - 1 elements before it are read from the file for each lookup.
+struct IndexedReadT
+{
+	public:
+		IndexedReadT(void);
+		~IndexedReadT(void);
+		ReadErrorT Open(Filesystem::PathT const &Path, Filesystem::PathT const &IndexPath);
+		size_t Count(void) const;
+		ReadErrorT Read(size_t Index, ReadT &Read); // Parses the element with Read as if it were the whole document
+		
+	private:
+		std::string Path;
+		FILE *File;
+		uint64_t Stride;
+		uint64_t Elements;
+		std::vector<uint64_t> Offsets;
+		std::string Buffer;
+};
+
+//================================================================================================================
+// Read-only document tree, for random access or multiple passes.  Nodes and text live in an arena which is released
+// all at once.  Strings, binary and numbers are kept as source text and decoded when accessed.
+struct DomBuilderT;
+
+struct DomT
+{
+	public:
+		typedef uint32_t NodeIDT;
+		enum struct TypeT : uint8_t { Bool, Number, String, Binary, Object, Array };
+		
+		DomT(std::pmr::memory_resource *Upstream = std::pmr::get_default_resource());
+		ReadErrorT Parse(Filesystem::PathT const &Path, ReadLimitsT const &Limits = {});
+		ReadErrorT Parse(std::istream &Stream, ReadLimitsT const &Limits = {});
+		ReadErrorT Parse(std::istream &&Stream, ReadLimitsT const &Limits = {});
+		void Clear(void);
+		
+		bool Empty(void) const;
+		NodeIDT Root(void) const;
+		TypeT Type(NodeIDT Node) const;
+		size_t Count(NodeIDT Node) const; // Children of an object or array
+		NodeIDT Child(NodeIDT Node, size_t Index) const;
+		std::string_view Key(NodeIDT Node) const; // Empty unless Node is an object member
+		OptionalT<NodeIDT> Find(NodeIDT Object, std::string_view Key) const;
+		
+		bool Bool(NodeIDT Node) const;
+		OptionalT<int64_t> Int(NodeIDT Node) const;
+		OptionalT<uint64_t> UInt(NodeIDT Node) const;
+		OptionalT<float> Float(NodeIDT Node) const;
+		std::string_view String(NodeIDT Node) const;
+		std::vector<uint8_t> Binary(NodeIDT Node) const;
+		
+	friend struct DomBuilderT;
+	private:
+		static uint32_t const NoKey = std::numeric_limits<uint32_t>::max();
+		struct NodeT
+		{
+			TypeT Type;
+			uint32_t Key;
+			uint32_t Length; // Children or text bytes
+			union
+			{
+				bool Bool;
+				size_t FirstChild; // Index into Children
+				char const *Text; // In Arena, without tag
+			};
+		};
+		
+		std::pmr::monotonic_buffer_resource Arena;
+		std::pmr::vector<NodeT> Nodes;
+		std::pmr::vector<NodeIDT> Children;
+		std::pmr::vector<std::string_view> Keys; // In Arena
+		std::pmr::unordered_map<std::string_view, uint32_t> KeyIDs;
+};
+
 }
 
 #endif